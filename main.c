@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -6,8 +7,36 @@
 #include <errno.h>
 #include <time.h>
 #include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <glob.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#ifdef __linux__
+#include <sys/uio.h>
+#endif
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
 
 #define OUTPUT_FILE_PATH "output.ppm"
+#define OUTPUT_VOLUME_FILE_PATH "volume.ppm"
+#define OUTPUT_SPHERE_FILE_PATH "sphere.ppm"
+#define SEED_INDEX_FILE_PATH "seeds.idx"
+#define OUTPUT_OUTLINE_FILE_PATH "output.svg"
+#define OUTPUT_VOR_FILE_PATH "output.vor"
+#define OUTPUT_PNG_FILE_PATH "output.png"
+#define OUTPUT_GIF_FILE_PATH "output.gif"
+#define OUTPUT_PGM_FILE_PATH "output.pgm"
+#define OUTPUT_PFM_FILE_PATH "output.pfm"
 
 #define WIDTH  1000
 #define HEIGHT 1000
@@ -20,6 +49,104 @@
 #define COLOR_BLACK 0xFF000000
 #define COLOR_BACKGROUND 0xFF201717
 
+#define VOLUME_SIZE 256
+#define VOLUME_SEEDS_COUNT 512
+#define VOLUME_GRID_SIZE 8
+#define VOLUME_GRID_CELL_SIZE ((VOLUME_SIZE + VOLUME_GRID_SIZE - 1) / VOLUME_GRID_SIZE)
+
+#define SPHERE_WIDTH  2048
+#define SPHERE_HEIGHT 1024
+#define SPHERE_SEEDS_COUNT 500
+#define SPHERE_GRID_SIZE 12
+#define SPHERE_GRID_CELL_SIZE (2.0f / SPHERE_GRID_SIZE)
+
+#define SEED_GRID_DENSITY 2
+#define POLYGON_MAX_VERTICES 256
+#define POLYGON_TOLERANCE 1e-6
+#define TILE_SIZE 32
+#define TILE_MIN_SIZE 8
+#define TILE_MAX_CANDIDATES 512
+#define LABEL_NONE UINT32_MAX
+#define LABEL_MARKER (UINT32_MAX - 1)
+
+#define JITTER_CELL_SIZE 64
+#define JITTER_AMOUNT 0.65
+#define FBM_OCTAVES 6
+#define FBM_MAX_COLUMNS (WIDTH / 2 + 4)
+#define FBM_RUN_MIN_CELL_SIZE 16
+#define OCTAVES_COUNT (sizeof(octaves) / sizeof(octaves[0]))
+#define JITTER_MAX_SEEDS (((WIDTH + JITTER_CELL_SIZE - 1) / JITTER_CELL_SIZE + 3) * ((HEIGHT + JITTER_CELL_SIZE - 1) / JITTER_CELL_SIZE + 3))
+
+#define APPROXIMATE_EPSILON 0.25
+#define APPROXIMATE_MIN_BLOCK 4
+#define BENCH_REPEATS 3
+#define BENCH_STAGE_SECONDS 0.5
+#define RAPL_ROOT "/sys/class/powercap"
+#define RAPL_MAX_DOMAINS 16
+
+#define CVT_HISTORY 8
+#define CVT_PASSES 300
+#define CVT_REPORT_EVERY 25
+#define CVT_MAX_HALVINGS 12
+
+#define CAPACITY_ITERATIONS 100
+#define CAPACITY_TOLERANCE 0.02
+#define CAPACITY_CG_ITERATIONS 500
+#define CAPACITY_CG_TOLERANCE 1e-3
+#define CAPACITY_MIN_STEP (1.0 / 16)
+
+#define LAYERS_COUNT (sizeof(layers) / sizeof(layers[0]))
+
+#define NESTED_FINE_SEEDS_COUNT 2000
+#define NESTED_MAX_FINE_SEEDS (UINT32_MAX - SEEDS_COUNT)
+#define NESTED_TILE_PARENTS 8
+#define NESTED_FINE_BLEND 0.5
+
+#define EDGE_WIDTH 2.0
+#define EDGE_COLOR COLOR_WHITE
+
+#define MAX_THREADS 64
+#define CACHE_LINE_SIZE 64
+#define PROGRESS_INTERVAL_MS 1000
+#define FRAME_ARENA_SIZE (256 << 20)
+#define ARENA_ALIGNMENT 64
+#define TILE_POOL_BLOCKS 16
+
+#define SEED_INDEX_MAGIC "VORIDX01"
+#define SEED_INDEX_ALIGNMENT 64
+#define QUERY_BATCH_SIZE (1 << 16)
+
+#define PLAN_BASE_BYTES (4 << 20)
+
+#define OUT_OF_CORE_BAND_HEIGHT 64
+#define OUT_OF_CORE_CHUNK_SEEDS (1 << 20)
+#define OUT_OF_CORE_BUCKET_SEEDS 4096
+#define OUT_OF_CORE_MAX_SEEDS (UINT64_MAX / sizeof(SeedRecord))
+
+#define PALETTE_MAX_COLORS 256
+#define PNG_STORED_BLOCK_SIZE 65535
+#define GIF_MAX_CODE 4095
+#define GIF_HASH_SIZE 8192
+
+#define VOR_MAGIC "VORCELL1"
+#define VOR_MAX_VARINT_BYTES 10
+
+#define OUTLINE_MAGIC "VORPOLY1"
+#define OUTLINE_TOLERANCE 0.75
+#define OUTLINE_BATCH_CELLS 4096
+
+#define DELAUNAY_SUPER_RADIUS 6144
+#define DELAUNAY_SUPER_VERTEX 0xFFFFFFF0u
+#define DELAUNAY_MAX_CAVITY 256
+#define DELAUNAY_AFFECTED 1
+#define DELAUNAY_INSERTED 2
+#define ANIMATE_FRAMES 60
+#define ANIMATE_MAX_SPEED 3
+#define RELAY_CHUNK_SIZE (1 << 20)
+
+#define EDIT_MOVES_COUNT 1000
+#define EDIT_MOVE_DISTANCE 20
+
 #define SEED_MARKER_RADIUS 4
 #define SEED_MARKER_COLOR COLOR_BLACK
 
@@ -27,9 +154,251 @@ typedef uint32_t Color;
 typedef struct {
     int x, y;
 } Vec2;
+typedef struct {
+    int x, y, z;
+} Vec3;
+typedef struct {
+    double x, y;
+} Vec2d;
+typedef struct {
+    float x, y;
+} Vec2f;
+typedef struct {
+    float x, y, z;
+} Vec3f;
+
+typedef struct {
+    int inMemory;
+    int bandHeight;
+    int gridDensity;
+    int threads;
+    size_t budgetBytes, indexBytes, bandBytes, tileCacheBytes, encoderBytes, totalBytes;
+} RenderPlan;
+
+typedef struct {
+    int32_t x, y;
+    uint64_t index;
+} SeedRecord;
+
+typedef struct {
+    int fd;
+    size_t bandsCount;
+    uint64_t *bandStart;
+} SeedBands;
+
+typedef struct {
+    const SeedBands *bands;
+    size_t band;
+    SeedRecord *records;
+    pthread_t thread;
+    int active;
+} BandPrefetch;
+
+typedef enum {
+    STAGE_INDEX,
+    STAGE_RENDER,
+    STAGE_COLOR,
+    STAGE_ENCODE,
+    STAGE_WRITE,
+    STAGES_COUNT
+} Stage;
+
+typedef struct {
+    _Atomic uint64_t tiles;
+    _Atomic uint64_t pixels;
+    _Atomic uint64_t bytes;
+    _Atomic uint64_t busyNanos;
+    char padding[CACHE_LINE_SIZE - 4 * sizeof(uint64_t)];
+} ProgressCounters;
+
+typedef struct {
+    int enabled;
+    const char *statusPath;
+    int threads;
+    uint64_t beginNanos;
+    _Atomic int stage;
+    _Atomic uint64_t stageBeginNanos;
+    _Atomic uint64_t stageNanos[STAGES_COUNT];
+    pthread_t reporter;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    int stopping;
+} Progress;
+
+typedef struct {
+    const Vec2 *points;
+    size_t count;
+    int originX, originY;
+    int cols, rows;
+    int cellSize;
+    const uint32_t *cellStart;
+    const uint32_t *cellSeeds;
+    void *mapping;
+    size_t mappingSize;
+} SeedGrid;
+
+typedef struct {
+    int begin, end;
+} Span;
+typedef struct {
+    Span *spans;
+    size_t count, capacity;
+    uint32_t rowStart[HEIGHT + 1];
+} DomainMask;
+
+typedef struct {
+    int minX, minY, maxX, maxY, startX;
+    int64_t area;
+} CellBounds;
+
+typedef struct {
+    Vec2 *points;
+    uint8_t *anchors;
+    size_t count, capacity;
+    uint32_t *loopEnds;
+    size_t loopsCount, loopsCapacity;
+} Outline;
+
+typedef struct {
+    uint8_t *base;
+    size_t size, used, highWater;
+} Arena;
+typedef struct {
+    uint8_t *blocks;
+    void *freeList;
+    size_t blockSize, capacity, next;
+    size_t inUse, highWater;
+} Pool;
+typedef enum {
+    METRIC_EUCLIDEAN,
+    METRIC_MANHATTAN
+} Metric;
+typedef enum {
+    BLEND_NORMAL,
+    BLEND_MULTIPLY,
+    BLEND_SCREEN,
+    BLEND_ADD,
+    BLEND_DIFFERENCE
+} BlendMode;
+typedef struct {
+    size_t seedsCount;
+    Metric metric;
+    BlendMode blend;
+    double opacity;
+} Layer;
+
+typedef struct {
+    int cellSize;
+    float gain;
+} Octave;
+
+typedef enum {
+    BENCH_RENDER_EXACT,
+    BENCH_RENDER_POLYGON,
+    BENCH_RENDER_APPROXIMATE,
+    BENCH_COLOR,
+    BENCH_WRITE_PPM,
+    BENCH_WRITE_PNG,
+    BENCH_WRITE_GIF,
+    BENCH_STAGES_COUNT
+} BenchStage;
+
+typedef struct {
+    size_t count;
+    int fds[RAPL_MAX_DOMAINS];
+    uint64_t maxRanges[RAPL_MAX_DOMAINS];
+} Rapl;
+
+typedef struct {
+    uint64_t key;
+    double weight;
+} CellAdjacency;
+
+typedef struct {
+    uint32_t seedIdxs[TILE_MAX_CANDIDATES];
+    int candidatesX[TILE_MAX_CANDIDATES];
+    int candidatesY[TILE_MAX_CANDIDATES];
+} TileBuffer;
+
+typedef struct {
+    char magic[8];
+    uint64_t count;
+    int32_t originX, originY;
+    int32_t cols, rows;
+    int32_t cellSize, reserved;
+    uint64_t pointsOffset;
+    uint64_t cellStartOffset;
+    uint64_t cellSeedsOffset;
+    uint64_t fileSize;
+} SeedIndexHeader;
+
+typedef struct {
+    uint32_t vertices[3];
+    int32_t neighbours[3];
+} Triangle;
+typedef struct {
+    uint32_t from, to;
+    int32_t outside;
+} BoundaryEdge;
+
+typedef struct {
+    Vec2 *points;
+    size_t capacity;
+    Vec2 superVertices[3];
+    int32_t *vertexTriangles;
+    uint32_t *coincident;
+    Triangle *triangles;
+    int32_t *freeTriangles;
+    size_t trianglesCount, freeCount, trianglesCapacity;
+    int32_t lastTriangle;
+    uint8_t *affectedFlags;
+    uint32_t *affected;
+    size_t affectedCount;
+    int dirtyMinX, dirtyMinY, dirtyMaxX, dirtyMaxY;
+} Delaunay;
+
+static const Layer layers[] = {
+    {SEEDS_COUNT, METRIC_EUCLIDEAN, BLEND_NORMAL, 1.0},
+    {400, METRIC_MANHATTAN, BLEND_MULTIPLY, 0.7},
+    {12, METRIC_EUCLIDEAN, BLEND_SCREEN, 0.35},
+};
+static const Octave octaves[] = {
+    {256, 1.0f},
+    {128, 0.5f},
+    {64, 0.25f},
+    {32, 0.125f},
+    {16, 0.0625f},
+    {8, 0.03125f},
+    {4, 0.015625f},
+    {2, 0.0078125f},
+};
 
 static Color image[HEIGHT][WIDTH];
 static Vec2 seeds[SEEDS_COUNT];
+static uint32_t labels[HEIGHT][WIDTH];
+
+static uint8_t traced[HEIGHT][WIDTH];
+static Vec2 seedVelocities[SEEDS_COUNT];
+
+static Arena frameArenas[MAX_THREADS];
+static Pool tilePools[MAX_THREADS];
+
+static _Alignas(CACHE_LINE_SIZE) ProgressCounters progressCounters[MAX_THREADS];
+static Progress progress = {.lock = PTHREAD_MUTEX_INITIALIZER, .wake = PTHREAD_COND_INITIALIZER};
+static const char *stageNames[STAGES_COUNT] = {"index", "render", "color", "encode", "write"};
+static const char *benchStageNames[BENCH_STAGES_COUNT] = {
+    "render exact", "render polygon", "render approx", "color", "write ppm", "write png", "write gif"
+};
+
+static Vec3 volumeSeeds[VOLUME_SEEDS_COUNT];
+static uint32_t volumeGridStart[VOLUME_GRID_SIZE * VOLUME_GRID_SIZE * VOLUME_GRID_SIZE + 1];
+static uint32_t volumeGridSeeds[VOLUME_SEEDS_COUNT];
+static uint32_t volumeSlices[2][VOLUME_SIZE][VOLUME_SIZE];
+
+static Vec3f sphereSeeds[SPHERE_SEEDS_COUNT];
+static uint32_t sphereGridStart[SPHERE_GRID_SIZE * SPHERE_GRID_SIZE * SPHERE_GRID_SIZE + 1];
+static uint32_t sphereGridSeeds[SPHERE_SEEDS_COUNT];
+static uint32_t sphereLabels[SPHERE_HEIGHT][SPHERE_WIDTH];
 
 
 /**
@@ -47,6 +416,272 @@ void FillImage(Color color)
     }
 }
 
+/**
+ * @brief Get the index of the calling render thread
+ * 
+ * @return size_t 
+ */
+size_t ThreadIndex() 
+{
+#ifdef _OPENMP
+    size_t index = omp_get_thread_num();
+#else
+    size_t index = 0;
+#endif
+    assert(index < MAX_THREADS);
+    return index;
+}
+
+/**
+ * @brief Get a monotonic timestamp
+ * 
+ * @return uint64_t Nanoseconds
+ */
+uint64_t NowNanos() 
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/**
+ * @brief Add to a counter that only the calling thread writes. A relaxed load
+ * and store is enough for the reporter to read it without tearing, and
+ * avoids the locked read-modify-write of an atomic add.
+ * 
+ * @param counter 
+ * @param amount 
+ * @return * Add 
+ */
+void BumpCounter(_Atomic uint64_t *counter, uint64_t amount) 
+{
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + amount, memory_order_relaxed);
+}
+
+/**
+ * @brief Count a finished tile on the calling thread's cache line
+ * 
+ * @param pixels 
+ * @param busyNanos Time the thread spent on the tile
+ * @return * Count 
+ */
+void ProgressTile(uint64_t pixels, uint64_t busyNanos) 
+{
+    ProgressCounters *counters = &progressCounters[ThreadIndex()];
+
+    BumpCounter(&counters->tiles, 1);
+    BumpCounter(&counters->pixels, pixels);
+    BumpCounter(&counters->busyNanos, busyNanos);
+}
+
+/**
+ * @brief Count bytes written to the output on the calling thread's cache line
+ * 
+ * @param bytes 
+ * @return * Count 
+ */
+void ProgressBytes(uint64_t bytes) 
+{
+    if (progress.enabled) {
+        BumpCounter(&progressCounters[ThreadIndex()].bytes, bytes);
+    }
+}
+
+/**
+ * @brief Switch the stage the job is in, charging the time since the last
+ * switch to the previous stage. Called from the main thread only.
+ * 
+ * @param stage 
+ * @return * Switch 
+ */
+void ProgressStage(Stage stage) 
+{
+    if (!progress.enabled) {
+        return;
+    }
+
+    uint64_t now = NowNanos();
+    int previous = atomic_load(&progress.stage);
+    atomic_fetch_add(&progress.stageNanos[previous], now - atomic_load(&progress.stageBeginNanos));
+    atomic_store(&progress.stageBeginNanos, now);
+    atomic_store(&progress.stage, stage);
+}
+
+/**
+ * @brief Format the state of the job: share of the image rendered and of the
+ * output written, throughput since the previous sample, time to completion,
+ * share of the elapsed time spent in each stage and how busy the render
+ * threads were while rendering
+ * 
+ * @param line 
+ * @param size 
+ * @param previous Totals of the previous sample, updated
+ * @param previousNanos Time of the previous sample, updated
+ * @return * Format 
+ */
+void FormatProgress(char *line, size_t size, uint64_t previous[4], uint64_t *previousNanos) 
+{
+    uint64_t now = NowNanos();
+    uint64_t totals[4] = {0};
+
+    for (size_t i = 0; i < MAX_THREADS; ++i) {
+        totals[0] += atomic_load_explicit(&progressCounters[i].tiles, memory_order_relaxed);
+        totals[1] += atomic_load_explicit(&progressCounters[i].pixels, memory_order_relaxed);
+        totals[2] += atomic_load_explicit(&progressCounters[i].bytes, memory_order_relaxed);
+        totals[3] += atomic_load_explicit(&progressCounters[i].busyNanos, memory_order_relaxed);
+    }
+
+    int stage = atomic_load(&progress.stage);
+    double stageSeconds[STAGES_COUNT];
+    for (int i = 0; i < STAGES_COUNT; ++i) {
+        stageSeconds[i] = atomic_load(&progress.stageNanos[i]) * 1e-9;
+    }
+    stageSeconds[stage] += (now - atomic_load(&progress.stageBeginNanos)) * 1e-9;
+
+    double elapsed = (now - progress.beginNanos) * 1e-9;
+    double interval = fmax((now - *previousNanos) * 1e-9, 1e-9);
+    double totalPixels = (double)WIDTH * HEIGHT;
+    double totalBytes = totalPixels * 3;
+    double rendered = fmin(totals[1] / totalPixels, 1);
+    double written = fmin(totals[2] / totalBytes, 1);
+
+    double remaining = 0;
+    if (rendered < 1) {
+        remaining = stageSeconds[STAGE_RENDER] * (1 - rendered) / fmax(rendered, 1e-9);
+    } else if (written < 1) {
+        remaining = stageSeconds[STAGE_WRITE] * (1 - written) / fmax(written, 1e-9);
+    }
+
+    int length = snprintf(line, size, "%s %5.1f%% rendered %5.1f%% written | %.1f Mpx/s %.0f tiles/s %.1f MB/s | elapsed %.0fs ETA %.0fs |",
+                          stageNames[stage], rendered * 100, written * 100,
+                          (totals[1] - previous[1]) / interval * 1e-6, (totals[0] - previous[0]) / interval,
+                          (totals[2] - previous[2]) / interval * 1e-6, elapsed, remaining);
+    for (int i = 0; i < STAGES_COUNT && length > 0 && (size_t)length < size; ++i) {
+        if (stageSeconds[i] > 0) {
+            length += snprintf(line + length, size - length, " %s %.0f%%", stageNames[i], stageSeconds[i] / fmax(elapsed, 1e-9) * 100);
+        }
+    }
+    if (length > 0 && (size_t)length < size && stageSeconds[STAGE_RENDER] > 0) {
+        snprintf(line + length, size - length, " | render threads %.0f%% busy",
+                 totals[3] * 1e-9 / (stageSeconds[STAGE_RENDER] * progress.threads) * 100);
+    }
+
+    memcpy(previous, totals, sizeof(totals));
+    *previousNanos = now;
+}
+
+/**
+ * @brief Publish a progress line on stderr, or as the whole content of the
+ * status file, replaced atomically so readers never see half a line
+ * 
+ * @param line 
+ * @return * Publish 
+ */
+void PublishProgress(const char *line) 
+{
+    if (progress.statusPath == NULL) {
+        fprintf(stderr, "progress: %s\n", line);
+        return;
+    }
+
+    char temporaryPath[4096];
+    snprintf(temporaryPath, sizeof(temporaryPath), "%s.tmp", progress.statusPath);
+    FILE *file = fopen(temporaryPath, "w");
+
+    if (file == NULL) {
+        fprintf(stderr, "ERROR: cannot write into file %s: %s\n", temporaryPath, strerror(errno));
+        return;
+    }
+    fprintf(file, "%s\n", line);
+    fclose(file);
+    rename(temporaryPath, progress.statusPath);
+}
+
+/**
+ * @brief Body of the reporter thread: sample the counters every
+ * PROGRESS_INTERVAL_MS until stopped, then publish a last sample
+ * 
+ * @param arg 
+ * @return void* 
+ */
+void *ProgressReporter(void *arg) 
+{
+    uint64_t previous[4] = {0};
+    uint64_t previousNanos = progress.beginNanos;
+    char line[512];
+    (void)arg;
+
+    pthread_mutex_lock(&progress.lock);
+    while (!progress.stopping) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += PROGRESS_INTERVAL_MS / 1000;
+        deadline.tv_nsec += PROGRESS_INTERVAL_MS % 1000 * 1000000;
+        if (deadline.tv_nsec >= 1000000000) {
+            deadline.tv_sec += 1;
+            deadline.tv_nsec -= 1000000000;
+        }
+
+        if (pthread_cond_timedwait(&progress.wake, &progress.lock, &deadline) == ETIMEDOUT) {
+            FormatProgress(line, sizeof(line), previous, &previousNanos);
+            PublishProgress(line);
+        }
+    }
+    pthread_mutex_unlock(&progress.lock);
+
+    previousNanos = progress.beginNanos;
+    memset(previous, 0, sizeof(previous));
+    FormatProgress(line, sizeof(line), previous, &previousNanos);
+    PublishProgress(line);
+    return NULL;
+}
+
+/**
+ * @brief Start counting tiles, pixels and bytes and reporting them from a
+ * separate thread
+ * 
+ * @param statusPath File to keep the last report in, or NULL for stderr
+ * @return * Start 
+ */
+void StartProgress(const char *statusPath) 
+{
+#ifdef _OPENMP
+    progress.threads = omp_get_max_threads();
+#else
+    progress.threads = 1;
+#endif
+    progress.statusPath = statusPath;
+    progress.beginNanos = NowNanos();
+    atomic_store(&progress.stage, STAGE_INDEX);
+    atomic_store(&progress.stageBeginNanos, progress.beginNanos);
+    progress.enabled = 1;
+
+    if (pthread_create(&progress.reporter, NULL, ProgressReporter, NULL) != 0) {
+        fprintf(stderr, "ERROR: cannot start the progress reporter\n");
+        progress.enabled = 0;
+    }
+}
+
+/**
+ * @brief Stop the reporter thread after it published the final totals, the
+ * throughput being averaged over the whole job
+ * 
+ * @return * Stop 
+ */
+void StopProgress() 
+{
+    if (!progress.enabled) {
+        return;
+    }
+
+    pthread_mutex_lock(&progress.lock);
+    progress.stopping = 1;
+    pthread_cond_signal(&progress.wake);
+    pthread_mutex_unlock(&progress.lock);
+    pthread_join(progress.reporter, NULL);
+    progress.enabled = 0;
+}
+
 /**
  * @brief Save image at specified path
  * 
@@ -77,6 +712,7 @@ void SaveImageAsPPM(const char *filePath)
             fwrite(bytes, sizeof(bytes), 1, file);
             assert(!ferror(file));
         }
+        ProgressBytes(WIDTH * 3);
     }
 
     int err = fclose(file);
@@ -90,7 +726,7 @@ void SaveImageAsPPM(const char *filePath)
  * @param b 
  * @return * Get 
  */
-int EuclideanDistance(Vec2 pointA, Vec2 pointB) 
+int SquareDistance(Vec2 pointA, Vec2 pointB) 
 {
     int dx = pointA.x - pointB.x;
     int dy = pointA.y - pointB.y;
@@ -156,6 +792,91 @@ void GenerateRandomSeeds()
     }
 }
 
+/**
+ * @brief Hash the coordinates of a grid cell
+ * 
+ * @param cellX 
+ * @param cellY 
+ * @param salt 
+ * @return uint32_t 
+ */
+uint32_t HashCell(int64_t cellX, int64_t cellY, uint32_t salt) 
+{
+    uint64_t h = (uint64_t)cellX * 0x9E3779B97F4A7C15ull ^ (uint64_t)cellY * 0xC2B2AE3D27D4EB4Full ^ salt;
+
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDull;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ull;
+    h ^= h >> 33;
+    return (uint32_t)h;
+}
+
+/**
+ * @brief Get the position of the seed of a jittered grid cell, relative to the
+ * cell corner. Seeds stay within JITTER_AMOUNT of a cell around its centre;
+ * up to 0.65, the closest seed of any pixel is always in the 3x3 cells around
+ * the pixel's cell.
+ * 
+ * @param cellX 
+ * @param cellY 
+ * @return Vec2 
+ */
+Vec2 JitteredSeedOffset(int64_t cellX, int64_t cellY) 
+{
+    int low = (int)ceil(JITTER_CELL_SIZE * (1 - JITTER_AMOUNT) / 2);
+    int high = (int)floor(JITTER_CELL_SIZE * (1 + JITTER_AMOUNT) / 2);
+    Vec2 offset = {
+        low + HashCell(cellX, cellY, 0x51ED270B) % (high - low + 1),
+        low + HashCell(cellX, cellY, 0x2545F491) % (high - low + 1)
+    };
+
+    return offset;
+}
+
+/**
+ * @brief Divide rounding towards negative infinity
+ * 
+ * @param a 
+ * @param b 
+ * @return int64_t 
+ */
+int64_t FloorDiv(int64_t a, int64_t b) 
+{
+    return a / b - (a % b != 0 && (a < 0) != (b < 0));
+}
+
+/**
+ * @brief Generate the jittered grid seeds of every cell that can own a pixel
+ * of the image placed at an offset on the infinite canvas: the cells under
+ * the image and one more cell all around, in row-major order, relative to
+ * the image
+ * 
+ * @param points Room for JITTER_MAX_SEEDS points
+ * @param originX 
+ * @param originY 
+ * @return size_t Number of seeds
+ */
+size_t GenerateJitteredSeeds(Vec2 *points, int64_t originX, int64_t originY) 
+{
+    int64_t firstCellX = FloorDiv(originX, JITTER_CELL_SIZE) - 1;
+    int64_t firstCellY = FloorDiv(originY, JITTER_CELL_SIZE) - 1;
+    int64_t endCellX = FloorDiv(originX + WIDTH - 1, JITTER_CELL_SIZE) + 2;
+    int64_t endCellY = FloorDiv(originY + HEIGHT - 1, JITTER_CELL_SIZE) + 2;
+    size_t count = 0;
+
+    for (int64_t cellY = firstCellY; cellY < endCellY; ++cellY) {
+        for (int64_t cellX = firstCellX; cellX < endCellX; ++cellX) {
+            Vec2 offset = JitteredSeedOffset(cellX, cellY);
+
+            points[count].x = cellX * JITTER_CELL_SIZE + offset.x - originX;
+            points[count].y = cellY * JITTER_CELL_SIZE + offset.y - originY;
+            ++count;
+        }
+    }
+    return count;
+}
+
 /**
  * @brief Render the seed markers in the image
  * 
@@ -188,39 +909,7229 @@ Color SeedToColor(Vec2 point)
 }
 
 /**
- * @brief Generate the Voronoi algorithm and render it
+ * @brief Mix two colors channel by channel
  * 
- * @return * Generate 
+ * @param colorA 
+ * @param colorB 
+ * @param t Weight of colorB, from 0 to 1
+ * @return Color 
  */
-void RenderVoronoi()
+Color BlendColors(Color colorA, Color colorB, double t) 
 {
-    for (int y = 0; y < HEIGHT; ++y) {
-        for (int x = 0; x < WIDTH; ++x) {
-            int closestSeedIdx = 0;
-            Vec2 point = {x, y};
+    Color blended = 0;
 
-            for (size_t i = 1; i < SEEDS_COUNT; ++i) {
-                int currDist = SquareDistance(seeds[i], point);
-                int closestDist = SquareDistance(seeds[closestSeedIdx], point);
+    for (int shift = 0; shift < 32; shift += 8) {
+        double a = (colorA >> shift) & 0xFF;
+        double b = (colorB >> shift) & 0xFF;
+        blended |= (Color)(a + (b - a) * t + 0.5) << shift;
+    }
+    return blended;
+}
 
-                if (currDist < closestDist) {
-                    closestSeedIdx = i;
-                }
-            }
+/**
+ * @brief Bump-allocate aligned scratch memory from an arena. The backing block
+ * is reserved on first use and only ever touched as far as it is used.
+ * 
+ * @param arena 
+ * @param size 
+ * @return void* 
+ */
+void *ArenaAlloc(Arena *arena, size_t size) 
+{
+    if (arena->base == NULL) {
+        arena->size = FRAME_ARENA_SIZE;
+        arena->base = malloc(arena->size);
+        assert(arena->base != NULL);
+    }
 
-            Vec2 seedPos = {seeds[closestSeedIdx].x, seeds[closestSeedIdx].y};
-            image[y][x] = SeedToColor(seedPos);
-        }
+    size_t offset = (arena->used + ARENA_ALIGNMENT - 1) / ARENA_ALIGNMENT * ARENA_ALIGNMENT;
+    if (offset + size > arena->size) {
+        fprintf(stderr, "ERROR: frame arena exhausted by a %zu bytes request, raise FRAME_ARENA_SIZE\n", size);
+        exit(1);
     }
+
+    arena->used = offset + size;
+    arena->highWater = arena->used > arena->highWater ? arena->used : arena->highWater;
+    return arena->base + offset;
 }
 
-int main(void) 
+/**
+ * @brief Drop everything allocated from an arena after a mark taken from its
+ * used size, in constant time
+ * 
+ * @param arena 
+ * @param mark 
+ * @return * Rewind 
+ */
+void ArenaRewind(Arena *arena, size_t mark) 
 {
-    srand(time(0));
-    FillImage(COLOR_BACKGROUND);
-    GenerateRandomSeeds();
-    RenderVoronoi();
-    RenderSeedMarkers();
-    SaveImageAsPPM(OUTPUT_FILE_PATH);
+    assert(mark <= arena->used);
+    arena->used = mark;
+}
+
+/**
+ * @brief Get the frame arena of the calling thread
+ * 
+ * @return Arena* 
+ */
+Arena *ThreadArena() 
+{
+    return &frameArenas[ThreadIndex()];
+}
+
+/**
+ * @brief Take a fixed-size block from a pool, reserving the pool's blocks the
+ * first time it is used
+ * 
+ * @param pool 
+ * @param blockSize 
+ * @return void* 
+ */
+void *PoolAlloc(Pool *pool, size_t blockSize) 
+{
+    if (pool->blocks == NULL) {
+        pool->blockSize = (blockSize + ARENA_ALIGNMENT - 1) / ARENA_ALIGNMENT * ARENA_ALIGNMENT;
+        pool->capacity = TILE_POOL_BLOCKS;
+        pool->blocks = malloc(pool->blockSize * pool->capacity);
+        assert(pool->blocks != NULL);
+    }
+    assert(blockSize <= pool->blockSize);
+
+    void *block;
+    if (pool->freeList != NULL) {
+        block = pool->freeList;
+        pool->freeList = *(void **)block;
+    } else if (pool->next < pool->capacity) {
+        block = pool->blocks + pool->next++ * pool->blockSize;
+    } else {
+        fprintf(stderr, "ERROR: tile pool exhausted, raise TILE_POOL_BLOCKS\n");
+        exit(1);
+    }
+
+    ++pool->inUse;
+    pool->highWater = pool->inUse > pool->highWater ? pool->inUse : pool->highWater;
+    return block;
+}
+
+/**
+ * @brief Return a block to its pool
+ * 
+ * @param pool 
+ * @param block 
+ * @return * Pool 
+ */
+void PoolFree(Pool *pool, void *block) 
+{
+    *(void **)block = pool->freeList;
+    pool->freeList = block;
+    --pool->inUse;
+}
+
+/**
+ * @brief Get the tile buffer pool of the calling thread
+ * 
+ * @return Pool* 
+ */
+Pool *ThreadTilePool() 
+{
+    return &tilePools[ThreadIndex()];
+}
+
+/**
+ * @brief Reset every thread's arena and pool between frames. Memory stays
+ * reserved so the next frame allocates nothing from the system.
+ * 
+ * @return * Reset 
+ */
+void ResetFrameArenas() 
+{
+    for (size_t i = 0; i < MAX_THREADS; ++i) {
+        assert(tilePools[i].inUse == 0);
+        tilePools[i].freeList = NULL;
+        tilePools[i].next = 0;
+        frameArenas[i].used = 0;
+    }
+}
+
+/**
+ * @brief Print the high-water marks of the arenas and pools that were used
+ * 
+ * @return * Report 
+ */
+void ReportArenaUsage() 
+{
+    for (size_t i = 0; i < MAX_THREADS; ++i) {
+        if (frameArenas[i].base != NULL || tilePools[i].blocks != NULL) {
+            fprintf(stderr, "thread %zu: arena high water %zu bytes, tile pool high water %zu blocks of %zu bytes\n",
+                    i, frameArenas[i].highWater, tilePools[i].highWater, tilePools[i].blockSize);
+        }
+    }
+}
+
+/**
+ * @brief Color every labelled pixel of the image with the color of its seed
+ * 
+ * @param points 
+ * @return * Render 
+ */
+void RenderLabels(const Vec2 *points) 
+{
+    for (size_t y = 0; y < HEIGHT; ++y) {
+        for (size_t x = 0; x < WIDTH; ++x) {
+            if (labels[y][x] != LABEL_NONE) {
+                image[y][x] = SeedToColor(points[labels[y][x]]);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Mark the seed markers in the label buffer as LABEL_MARKER, over the
+ * same pixels as RenderSeedMarkers
+ * 
+ * @param points 
+ * @param count 
+ * @return * Stamp 
+ */
+void StampSeedMarkers(const Vec2 *points, size_t count) 
+{
+    for (size_t i = 0; i < count; ++i) {
+        for (int y = points[i].y - SEED_MARKER_RADIUS; y < points[i].y + SEED_MARKER_RADIUS; ++y) {
+            for (int x = points[i].x - SEED_MARKER_RADIUS; x < points[i].x + SEED_MARKER_RADIUS; ++x) {
+                Vec2 point = {x, y};
+
+                if (0 <= x && x < WIDTH && 0 <= y && y < HEIGHT
+                    && SquareDistance(points[i], point) <= SEED_MARKER_RADIUS * SEED_MARKER_RADIUS) {
+                    labels[y][x] = LABEL_MARKER;
+                }
+            }
+        }
+    }
+}
+
+/**
+ * @brief Build the palette of an indexed image from the label buffer: the
+ * seed colors, then the marker and background colors when some pixel uses
+ * them, shared between equal colors. Labels map to palette indices through
+ * labelIdxs, seeds first, then LABEL_MARKER and LABEL_NONE.
+ * 
+ * @param points 
+ * @param count 
+ * @param palette PALETTE_MAX_COLORS long
+ * @param labelIdxs count + 2 long
+ * @return size_t Palette size, 0 if the colors do not fit
+ */
+size_t BuildLabelPalette(const Vec2 *points, size_t count, Color *palette, uint8_t *labelIdxs) 
+{
+    int usesMarker = 0, usesBackground = 0;
+    size_t paletteCount = 0;
+
+    for (size_t y = 0; y < HEIGHT; ++y) {
+        for (size_t x = 0; x < WIDTH; ++x) {
+            usesMarker |= labels[y][x] == LABEL_MARKER;
+            usesBackground |= labels[y][x] == LABEL_NONE;
+        }
+    }
+
+    for (size_t i = 0; i < count + 2; ++i) {
+        Color color = i < count ? SeedToColor(points[i]) : i == count ? SEED_MARKER_COLOR : COLOR_BACKGROUND;
+        size_t p = 0;
+
+        if ((i == count && !usesMarker) || (i == count + 1 && !usesBackground)) {
+            labelIdxs[i] = 0;
+            continue;
+        }
+        color &= 0xFFFFFF;
+        while (p < paletteCount && palette[p] != color) {
+            ++p;
+        }
+        if (p == paletteCount) {
+            if (paletteCount == PALETTE_MAX_COLORS) {
+                return 0;
+            }
+            palette[paletteCount++] = color;
+        }
+        labelIdxs[i] = (uint8_t)p;
+    }
+    return paletteCount;
+}
+
+/**
+ * @brief Turn a row of the label buffer into palette indices
+ * 
+ * @param y 
+ * @param count 
+ * @param labelIdxs 
+ * @param row WIDTH long
+ * @return * Encode 
+ */
+void EncodeLabelIndices(int y, size_t count, const uint8_t *labelIdxs, uint8_t *row) 
+{
+    for (int x = 0; x < WIDTH; ++x) {
+        uint32_t label = labels[y][x];
+        row[x] = labelIdxs[label < count ? label : label == LABEL_MARKER ? count : count + 1];
+    }
+}
+
+/**
+ * @brief Update a CRC-32 as used by PNG chunks
+ * 
+ * @param crc 0 to start
+ * @param data 
+ * @param size 
+ * @return uint32_t 
+ */
+uint32_t Crc32(uint32_t crc, const uint8_t *data, size_t size) 
+{
+    static uint32_t table[256];
+
+    if (table[1] == 0) {
+        for (uint32_t n = 0; n < 256; ++n) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; ++k) {
+                c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            table[n] = c;
+        }
+    }
+
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i) {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+/**
+ * @brief Update an Adler-32 as used by zlib streams
+ * 
+ * @param adler 1 to start
+ * @param data 
+ * @param size 
+ * @return uint32_t 
+ */
+uint32_t Adler32(uint32_t adler, const uint8_t *data, size_t size) 
+{
+    uint32_t a = adler & 0xFFFF, b = adler >> 16;
+
+    while (size > 0) {
+        size_t run = size < 5552 ? size : 5552;
+
+        for (size_t i = 0; i < run; ++i) {
+            a += data[i];
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+        data += run;
+        size -= run;
+    }
+    return b << 16 | a;
+}
+
+/**
+ * @brief Write a PNG chunk of a tag and any number of data pieces
+ * 
+ * @param file 
+ * @param tag 
+ * @param pieces 
+ * @param sizes 
+ * @param piecesCount 
+ * @return * Write 
+ */
+void WritePNGChunk(FILE *file, const char *tag, const uint8_t **pieces, const size_t *sizes, size_t piecesCount) 
+{
+    size_t size = 0;
+    for (size_t i = 0; i < piecesCount; ++i) {
+        size += sizes[i];
+    }
+
+    uint8_t length[4] = {(uint8_t)(size >> 24), (uint8_t)(size >> 16), (uint8_t)(size >> 8), (uint8_t)size};
+    uint32_t crc = Crc32(0, (const uint8_t *)tag, 4);
+
+    fwrite(length, 4, 1, file);
+    fwrite(tag, 4, 1, file);
+    for (size_t i = 0; i < piecesCount; ++i) {
+        crc = Crc32(crc, pieces[i], sizes[i]);
+        fwrite(pieces[i], sizes[i], 1, file);
+    }
+
+    uint8_t crcBytes[4] = {(uint8_t)(crc >> 24), (uint8_t)(crc >> 16), (uint8_t)(crc >> 8), (uint8_t)crc};
+    fwrite(crcBytes, 4, 1, file);
+    assert(!ferror(file));
+}
+
+/**
+ * @brief Save the label buffer as an 8-bit indexed PNG with its palette. The
+ * pixels are stored uncompressed in deflate stored blocks, one byte each with
+ * no row filter, so the cost is the write itself.
+ * 
+ * @param filePath 
+ * @param points 
+ * @param count 
+ * @return * Save 
+ */
+void SaveLabelsAsPNG(const char *filePath, const Vec2 *points, size_t count) 
+{
+    Color palette[PALETTE_MAX_COLORS];
+    uint8_t *labelIdxs = malloc(count + 2);
+    assert(labelIdxs != NULL);
+
+    size_t paletteCount = BuildLabelPalette(points, count, palette, labelIdxs);
+    if (paletteCount == 0) {
+        fprintf(stderr, "ERROR: more than %d colors, an indexed image cannot hold them\n", PALETTE_MAX_COLORS);
+        exit(1);
+    }
+
+    FILE *file = fopen(filePath, "wb");
+    if (file == NULL) {
+        fprintf(stderr, "ERROR: cannot write into file %s: %s\n", filePath, strerror(errno));
+        exit(1);
+    }
+
+    ProgressStage(STAGE_ENCODE);
+    size_t rowSize = WIDTH + 1;
+    size_t rawSize = rowSize * HEIGHT;
+    uint8_t *raw = malloc(rawSize);
+    assert(raw != NULL);
+
+    #pragma omp parallel for schedule(static)
+    for (int y = 0; y < HEIGHT; ++y) {
+        raw[y * rowSize] = 0;
+        EncodeLabelIndices(y, count, labelIdxs, &raw[y * rowSize + 1]);
+    }
+
+    static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    uint8_t header[13] = {
+        (uint8_t)(WIDTH >> 24), (uint8_t)(WIDTH >> 16), (uint8_t)(WIDTH >> 8), (uint8_t)WIDTH,
+        (uint8_t)(HEIGHT >> 24), (uint8_t)(HEIGHT >> 16), (uint8_t)(HEIGHT >> 8), (uint8_t)HEIGHT,
+        8, 3, 0, 0, 0
+    };
+    uint8_t paletteBytes[PALETTE_MAX_COLORS * 3];
+    const uint8_t *pieces[1];
+    size_t sizes[1];
+
+    for (size_t p = 0; p < paletteCount; ++p) {
+        paletteBytes[p * 3 + 0] = (uint8_t)(palette[p] >> 8 * 0);
+        paletteBytes[p * 3 + 1] = (uint8_t)(palette[p] >> 8 * 1);
+        paletteBytes[p * 3 + 2] = (uint8_t)(palette[p] >> 8 * 2);
+    }
+
+    ProgressStage(STAGE_WRITE);
+    fwrite(signature, sizeof(signature), 1, file);
+    pieces[0] = header;
+    sizes[0] = sizeof(header);
+    WritePNGChunk(file, "IHDR", pieces, sizes, 1);
+    pieces[0] = paletteBytes;
+    sizes[0] = paletteCount * 3;
+    WritePNGChunk(file, "PLTE", pieces, sizes, 1);
+
+    size_t blocksCount = (rawSize + PNG_STORED_BLOCK_SIZE - 1) / PNG_STORED_BLOCK_SIZE;
+    size_t piecesCount = 2 * blocksCount + 2;
+    const uint8_t **streamPieces = malloc(piecesCount * sizeof(uint8_t *));
+    size_t *streamSizes = malloc(piecesCount * sizeof(size_t));
+    uint8_t *blockHeaders = malloc(blocksCount * 5);
+    static const uint8_t zlibHeader[2] = {0x78, 0x01};
+    uint32_t adler = Adler32(1, raw, rawSize);
+    uint8_t zlibTrailer[4] = {(uint8_t)(adler >> 24), (uint8_t)(adler >> 16), (uint8_t)(adler >> 8), (uint8_t)adler};
+    assert(streamPieces != NULL && streamSizes != NULL && blockHeaders != NULL);
+
+    streamPieces[0] = zlibHeader;
+    streamSizes[0] = sizeof(zlibHeader);
+    for (size_t b = 0; b < blocksCount; ++b) {
+        size_t offset = b * PNG_STORED_BLOCK_SIZE;
+        size_t size = rawSize - offset < PNG_STORED_BLOCK_SIZE ? rawSize - offset : PNG_STORED_BLOCK_SIZE;
+        uint8_t *blockHeader = &blockHeaders[b * 5];
+
+        blockHeader[0] = b + 1 == blocksCount;
+        blockHeader[1] = (uint8_t)size;
+        blockHeader[2] = (uint8_t)(size >> 8);
+        blockHeader[3] = (uint8_t)~size;
+        blockHeader[4] = (uint8_t)(~size >> 8);
+        streamPieces[1 + 2 * b] = blockHeader;
+        streamSizes[1 + 2 * b] = 5;
+        streamPieces[2 + 2 * b] = &raw[offset];
+        streamSizes[2 + 2 * b] = size;
+    }
+    streamPieces[piecesCount - 1] = zlibTrailer;
+    streamSizes[piecesCount - 1] = sizeof(zlibTrailer);
+    WritePNGChunk(file, "IDAT", streamPieces, streamSizes, piecesCount);
+    WritePNGChunk(file, "IEND", NULL, NULL, 0);
+    ProgressBytes(rawSize);
+
+    int err = fclose(file);
+    assert(err == 0);
+    free(blockHeaders);
+    free(streamSizes);
+    free(streamPieces);
+    free(raw);
+    free(labelIdxs);
+}
+
+/**
+ * @brief Append a variable-width LZW code to a GIF image, flushing full 255
+ * byte sub-blocks
+ * 
+ * @param file 
+ * @param block 256 bytes, block[0] holding the sub-block size
+ * @param bits 
+ * @param bitsCount 
+ * @param code 
+ * @param codeSize 
+ * @return * Write 
+ */
+void WriteGIFCode(FILE *file, uint8_t *block, uint32_t *bits, int *bitsCount, uint32_t code, int codeSize) 
+{
+    *bits |= code << *bitsCount;
+    *bitsCount += codeSize;
+
+    while (*bitsCount >= 8) {
+        block[++block[0]] = (uint8_t)*bits;
+        *bits >>= 8;
+        *bitsCount -= 8;
+
+        if (block[0] == 255) {
+            fwrite(block, 256, 1, file);
+            block[0] = 0;
+        }
+    }
+}
+
+/**
+ * @brief Save the label buffer as a GIF with its palette. Pixels are LZW
+ * coded as the format requires, the dictionary being a hash of prefix code
+ * and next index, cleared once all 4096 codes are taken.
+ * 
+ * @param filePath 
+ * @param points 
+ * @param count 
+ * @return * Save 
+ */
+void SaveLabelsAsGIF(const char *filePath, const Vec2 *points, size_t count) 
+{
+    Color palette[PALETTE_MAX_COLORS];
+    uint8_t *labelIdxs = malloc(count + 2);
+    assert(labelIdxs != NULL);
+
+    size_t paletteCount = BuildLabelPalette(points, count, palette, labelIdxs);
+    if (paletteCount == 0) {
+        fprintf(stderr, "ERROR: more than %d colors, an indexed image cannot hold them\n", PALETTE_MAX_COLORS);
+        exit(1);
+    }
+
+    FILE *file = fopen(filePath, "wb");
+    if (file == NULL) {
+        fprintf(stderr, "ERROR: cannot write into file %s: %s\n", filePath, strerror(errno));
+        exit(1);
+    }
+
+    int depth = 1;
+    while ((1u << depth) < paletteCount) {
+        ++depth;
+    }
+
+    uint8_t screen[13] = {
+        'G', 'I', 'F', '8', '9', 'a',
+        (uint8_t)WIDTH, (uint8_t)(WIDTH >> 8), (uint8_t)HEIGHT, (uint8_t)(HEIGHT >> 8),
+        (uint8_t)(0xF0 | (depth - 1)), 0, 0
+    };
+    uint8_t paletteBytes[PALETTE_MAX_COLORS * 3] = {0};
+    uint8_t descriptor[10] = {
+        ',', 0, 0, 0, 0,
+        (uint8_t)WIDTH, (uint8_t)(WIDTH >> 8), (uint8_t)HEIGHT, (uint8_t)(HEIGHT >> 8), 0
+    };
+    int minCodeSize = depth < 2 ? 2 : depth;
+
+    for (size_t p = 0; p < paletteCount; ++p) {
+        paletteBytes[p * 3 + 0] = (uint8_t)(palette[p] >> 8 * 0);
+        paletteBytes[p * 3 + 1] = (uint8_t)(palette[p] >> 8 * 1);
+        paletteBytes[p * 3 + 2] = (uint8_t)(palette[p] >> 8 * 2);
+    }
+    fwrite(screen, sizeof(screen), 1, file);
+    fwrite(paletteBytes, (size_t)3 << depth, 1, file);
+    fwrite(descriptor, sizeof(descriptor), 1, file);
+    fputc(minCodeSize, file);
+
+    ProgressStage(STAGE_ENCODE);
+    uint8_t *row = malloc(WIDTH);
+    uint32_t *hashKeys = malloc(GIF_HASH_SIZE * sizeof(uint32_t));
+    uint16_t *hashCodes = malloc(GIF_HASH_SIZE * sizeof(uint16_t));
+    uint8_t block[256] = {0};
+    uint32_t bits = 0;
+    int bitsCount = 0;
+    uint32_t clearCode = 1u << minCodeSize;
+    uint32_t maxCode = clearCode + 1;
+    int codeSize = minCodeSize + 1;
+    int64_t prefix = -1;
+    assert(row != NULL && hashKeys != NULL && hashCodes != NULL);
+
+    memset(hashKeys, 0xFF, GIF_HASH_SIZE * sizeof(uint32_t));
+    WriteGIFCode(file, block, &bits, &bitsCount, clearCode, codeSize);
+
+    for (int y = 0; y < HEIGHT; ++y) {
+        EncodeLabelIndices(y, count, labelIdxs, row);
+
+        for (int x = 0; x < WIDTH; ++x) {
+            if (prefix < 0) {
+                prefix = row[x];
+                continue;
+            }
+
+            uint32_t key = (uint32_t)prefix << 8 | row[x];
+            size_t slot = (key * 2654435761u) >> (32 - 13) & (GIF_HASH_SIZE - 1);
+
+            while (hashKeys[slot] != UINT32_MAX && hashKeys[slot] != key) {
+                slot = (slot + 1) & (GIF_HASH_SIZE - 1);
+            }
+            if (hashKeys[slot] == key) {
+                prefix = hashCodes[slot];
+                continue;
+            }
+
+            WriteGIFCode(file, block, &bits, &bitsCount, (uint32_t)prefix, codeSize);
+            hashKeys[slot] = key;
+            hashCodes[slot] = (uint16_t)++maxCode;
+            if (maxCode >= (1u << codeSize) && codeSize < 12) {
+                ++codeSize;
+            }
+            if (maxCode == GIF_MAX_CODE) {
+                WriteGIFCode(file, block, &bits, &bitsCount, clearCode, codeSize);
+                memset(hashKeys, 0xFF, GIF_HASH_SIZE * sizeof(uint32_t));
+                maxCode = clearCode + 1;
+                codeSize = minCodeSize + 1;
+            }
+            prefix = row[x];
+        }
+    }
+
+    ProgressStage(STAGE_WRITE);
+    WriteGIFCode(file, block, &bits, &bitsCount, (uint32_t)prefix, codeSize);
+    if (maxCode + 1 == (1u << codeSize) && codeSize < 12) {
+        ++codeSize;
+    }
+    WriteGIFCode(file, block, &bits, &bitsCount, clearCode + 1, codeSize);
+    WriteGIFCode(file, block, &bits, &bitsCount, 0, 7);
+    if (block[0] > 0) {
+        fwrite(block, block[0] + 1, 1, file);
+    }
+    fputc(0, file);
+    fputc(';', file);
+    assert(!ferror(file));
+    ProgressBytes((uint64_t)WIDTH * HEIGHT);
+
+    int err = fclose(file);
+    assert(err == 0);
+    free(hashCodes);
+    free(hashKeys);
+    free(row);
+    free(labelIdxs);
+}
+
+/**
+ * @brief Bucket a subset of points, given by their indices, into a uniform
+ * grid spanning their bounding box, sized for about density points per cell.
+ * The grid keeps a pointer to the points, which must outlive it.
+ * The buckets come from the arena when one is given, and are then released
+ * with it rather than by FreeSeedGrid.
+ * 
+ * @param grid 
+ * @param points 
+ * @param seedIdxs 
+ * @param count 
+ * @param density 
+ * @param arena 
+ * @return * Build 
+ */
+void BuildSeedGridSubset(SeedGrid *grid, const Vec2 *points, const uint32_t *seedIdxs, size_t count, int density, Arena *arena) 
+{
+    assert(count > 0);
+
+    Vec2 first = points[seedIdxs != NULL ? seedIdxs[0] : 0];
+    int minX = first.x, minY = first.y;
+    int maxX = first.x, maxY = first.y;
+    for (size_t i = 1; i < count; ++i) {
+        Vec2 point = points[seedIdxs != NULL ? seedIdxs[i] : i];
+        minX = point.x < minX ? point.x : minX;
+        minY = point.y < minY ? point.y : minY;
+        maxX = point.x > maxX ? point.x : maxX;
+        maxY = point.y > maxY ? point.y : maxY;
+    }
+
+    double area = ((double)maxX - minX + 1) * ((double)maxY - minY + 1);
+    int cellSize = (int)ceil(sqrt(area * density / count));
+
+    grid->points = points;
+    grid->count = count;
+    grid->originX = minX;
+    grid->originY = minY;
+    grid->cellSize = cellSize > 0 ? cellSize : 1;
+    grid->cols = (maxX - minX) / grid->cellSize + 1;
+    grid->rows = (maxY - minY) / grid->cellSize + 1;
+
+    size_t cellsCount = (size_t)grid->cols * grid->rows;
+    uint32_t *cellStart, *cellSeeds;
+    if (arena != NULL) {
+        cellStart = ArenaAlloc(arena, (cellsCount + 1) * sizeof(uint32_t));
+        cellSeeds = ArenaAlloc(arena, count * sizeof(uint32_t));
+        memset(cellStart, 0, (cellsCount + 1) * sizeof(uint32_t));
+    } else {
+        cellStart = calloc(cellsCount + 1, sizeof(uint32_t));
+        cellSeeds = malloc(count * sizeof(uint32_t));
+        assert(cellStart != NULL && cellSeeds != NULL);
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        Vec2 point = points[seedIdxs != NULL ? seedIdxs[i] : i];
+        size_t cx = (point.x - minX) / grid->cellSize;
+        size_t cy = (point.y - minY) / grid->cellSize;
+        ++cellStart[cy * grid->cols + cx + 1];
+    }
+    for (size_t i = 0; i < cellsCount; ++i) {
+        cellStart[i + 1] += cellStart[i];
+    }
+    for (size_t i = 0; i < count; ++i) {
+        size_t seedIdx = seedIdxs != NULL ? seedIdxs[i] : i;
+        size_t cx = (points[seedIdx].x - minX) / grid->cellSize;
+        size_t cy = (points[seedIdx].y - minY) / grid->cellSize;
+        cellSeeds[cellStart[cy * grid->cols + cx]++] = seedIdx;
+    }
+    for (size_t i = cellsCount; i > 0; --i) {
+        cellStart[i] = cellStart[i - 1];
+    }
+    cellStart[0] = 0;
+
+    grid->cellStart = cellStart;
+    grid->cellSeeds = cellSeeds;
+    grid->mapping = NULL;
+    grid->mappingSize = 0;
+}
+
+/**
+ * @brief Bucket all points into a uniform grid, see BuildSeedGridSubset
+ * 
+ * @param grid 
+ * @param points 
+ * @param count 
+ * @param arena 
+ * @return * Build 
+ */
+void BuildSeedGrid(SeedGrid *grid, const Vec2 *points, size_t count, Arena *arena) 
+{
+    BuildSeedGridSubset(grid, points, NULL, count, SEED_GRID_DENSITY, arena);
+}
+
+/**
+ * @brief Release the buckets of a seed grid, or unmap it if it was loaded
+ * 
+ * @param grid 
+ * @return * Free 
+ */
+void FreeSeedGrid(SeedGrid *grid) 
+{
+    if (grid->mapping != NULL) {
+        munmap(grid->mapping, grid->mappingSize);
+    } else {
+        free((void *)grid->cellStart);
+        free((void *)grid->cellSeeds);
+    }
+    grid->cellStart = NULL;
+    grid->cellSeeds = NULL;
+    grid->mapping = NULL;
+}
+
+/**
+ * @brief Write the seeds together with their grid as flat arrays, addressed
+ * by offsets from the start of the file so it can be mapped anywhere. Grids
+ * built over a subset of their points cannot be saved.
+ * 
+ * @param grid 
+ * @param filePath 
+ * @return * Save 
+ */
+void SaveSeedGrid(const SeedGrid *grid, const char *filePath) 
+{
+    FILE *file = fopen(filePath, "wb");
+
+    if (file == NULL) {
+        fprintf(stderr, "ERROR: cannot write into file %s: %s\n", filePath, strerror(errno));
+        exit(1);
+    }
+
+    size_t cellsCount = (size_t)grid->cols * grid->rows;
+    size_t sizes[3] = {
+        grid->count * sizeof(Vec2),
+        (cellsCount + 1) * sizeof(uint32_t),
+        grid->count * sizeof(uint32_t)
+    };
+    const void *arrays[3] = {grid->points, grid->cellStart, grid->cellSeeds};
+    uint64_t offsets[3];
+    uint64_t offset = sizeof(SeedIndexHeader);
+
+    for (size_t i = 0; i < 3; ++i) {
+        offset = (offset + SEED_INDEX_ALIGNMENT - 1) / SEED_INDEX_ALIGNMENT * SEED_INDEX_ALIGNMENT;
+        offsets[i] = offset;
+        offset += sizes[i];
+    }
+
+    SeedIndexHeader header = {0};
+    memcpy(header.magic, SEED_INDEX_MAGIC, sizeof(header.magic));
+    header.count = grid->count;
+    header.originX = grid->originX;
+    header.originY = grid->originY;
+    header.cols = grid->cols;
+    header.rows = grid->rows;
+    header.cellSize = grid->cellSize;
+    header.pointsOffset = offsets[0];
+    header.cellStartOffset = offsets[1];
+    header.cellSeedsOffset = offsets[2];
+    header.fileSize = offset;
+
+    static const uint8_t padding[SEED_INDEX_ALIGNMENT];
+    fwrite(&header, sizeof(header), 1, file);
+    offset = sizeof(header);
+    for (size_t i = 0; i < 3; ++i) {
+        fwrite(padding, offsets[i] - offset, 1, file);
+        fwrite(arrays[i], sizes[i], 1, file);
+        offset = offsets[i] + sizes[i];
+    }
+    assert(!ferror(file));
+
+    int err = fclose(file);
+    assert(err == 0);
+}
+
+/**
+ * @brief Check that a region of a seed index is aligned and lies within the
+ * file, without letting its end wrap around
+ * 
+ * @param offset 
+ * @param count 
+ * @param elementSize 
+ * @param fileSize 
+ * @return int 
+ */
+int SeedIndexRegionFits(uint64_t offset, uint64_t count, size_t elementSize, size_t fileSize) 
+{
+    return offset % SEED_INDEX_ALIGNMENT == 0 && offset <= fileSize && count <= (fileSize - offset) / elementSize;
+}
+
+/**
+ * @brief Check the content of a mapped seed index before it is trusted: the
+ * cell starts rise from 0 to the seed count, every bucketed index names a
+ * seed, and every seed lies in the image, as coloring requires
+ * 
+ * @param mapping 
+ * @param cellsCount 
+ * @return int 
+ */
+int SeedIndexIsConsistent(const void *mapping, size_t cellsCount) 
+{
+    const SeedIndexHeader *header = mapping;
+    const uint8_t *base = mapping;
+    const Vec2 *points = (const Vec2 *)(base + header->pointsOffset);
+    const uint32_t *cellStart = (const uint32_t *)(base + header->cellStartOffset);
+    const uint32_t *cellSeeds = (const uint32_t *)(base + header->cellSeedsOffset);
+
+    if (cellStart[0] != 0 || cellStart[cellsCount] != header->count) {
+        return 0;
+    }
+    for (size_t i = 0; i < cellsCount; ++i) {
+        if (cellStart[i] > cellStart[i + 1]) {
+            return 0;
+        }
+    }
+    for (size_t i = 0; i < header->count; ++i) {
+        if (cellSeeds[i] >= header->count) {
+            return 0;
+        }
+        if (points[i].x < 0 || points[i].x >= WIDTH || points[i].y < 0 || points[i].y >= HEIGHT) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief Map a saved seed grid read-only. The seeds and buckets are used in
+ * place, so loading costs no copy and the pages are shared through the page
+ * cache by every process rendering from the same file.
+ * 
+ * @param grid 
+ * @param filePath 
+ * @return * Load 
+ */
+void LoadSeedGrid(SeedGrid *grid, const char *filePath) 
+{
+    int fd = open(filePath, O_RDONLY);
+    struct stat info;
+
+    if (fd < 0 || fstat(fd, &info) < 0) {
+        fprintf(stderr, "ERROR: cannot read file %s: %s\n", filePath, strerror(errno));
+        exit(1);
+    }
+
+    size_t size = info.st_size;
+    void *mapping = size >= sizeof(SeedIndexHeader) ? mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+
+    if (mapping == MAP_FAILED) {
+        fprintf(stderr, "ERROR: cannot map file %s: %s\n", filePath, strerror(errno));
+        exit(1);
+    }
+
+    const SeedIndexHeader *header = mapping;
+    size_t cellsCount = header->cols > 0 && header->rows > 0 ? (size_t)header->cols * header->rows : 0;
+
+    if (memcmp(header->magic, SEED_INDEX_MAGIC, sizeof(header->magic)) != 0 || header->fileSize != size
+        || header->count == 0 || header->count > UINT32_MAX || cellsCount == 0 || header->cellSize <= 0
+        || !SeedIndexRegionFits(header->pointsOffset, header->count, sizeof(Vec2), size)
+        || !SeedIndexRegionFits(header->cellStartOffset, cellsCount + 1, sizeof(uint32_t), size)
+        || !SeedIndexRegionFits(header->cellSeedsOffset, header->count, sizeof(uint32_t), size)
+        || !SeedIndexIsConsistent(mapping, cellsCount)) {
+        fprintf(stderr, "ERROR: file %s is not a valid seed index\n", filePath);
+        exit(1);
+    }
+
+    const uint8_t *base = mapping;
+    grid->points = (const Vec2 *)(base + header->pointsOffset);
+    grid->count = header->count;
+    grid->originX = header->originX;
+    grid->originY = header->originY;
+    grid->cols = header->cols;
+    grid->rows = header->rows;
+    grid->cellSize = header->cellSize;
+    grid->cellStart = (const uint32_t *)(base + header->cellStartOffset);
+    grid->cellSeeds = (const uint32_t *)(base + header->cellSeedsOffset);
+    grid->mapping = mapping;
+    grid->mappingSize = size;
+}
+
+/**
+ * @brief Find the grid cell of a point, clamped into the grid in double
+ * precision so that points far outside it start their search at its border
+ * 
+ * @param grid 
+ * @param x 
+ * @param y 
+ * @param col 
+ * @param row 
+ * @return * Clamp 
+ */
+void ClampGridCell(const SeedGrid *grid, double x, double y, int *col, int *row) 
+{
+    double colValue = floor((x - grid->originX) / grid->cellSize);
+    double rowValue = floor((y - grid->originY) / grid->cellSize);
+
+    *col = colValue >= 0 ? (colValue < grid->cols ? (int)colValue : grid->cols - 1) : 0;
+    *row = rowValue >= 0 ? (rowValue < grid->rows ? (int)rowValue : grid->rows - 1) : 0;
+}
+
+/**
+ * @brief Lower bound on the distance from a point to any grid cell not yet
+ * visited when a ring is about to be scanned, the ring included. Sides whose
+ * ring lies past the grid border have no cell left and do not bound anything.
+ * 
+ * @param grid 
+ * @param x 
+ * @param y 
+ * @param beginCol 
+ * @param endCol 
+ * @param beginRow 
+ * @param endRow 
+ * @return double 
+ */
+double RingReach(const SeedGrid *grid, double x, double y, int beginCol, int endCol, int beginRow, int endRow) 
+{
+    double left = beginCol >= 0 ? x - (grid->originX + (double)(beginCol + 1) * grid->cellSize) : INFINITY;
+    double right = endCol < grid->cols ? grid->originX + (double)endCol * grid->cellSize - x : INFINITY;
+    double top = beginRow >= 0 ? y - (grid->originY + (double)(beginRow + 1) * grid->cellSize) : INFINITY;
+    double bottom = endRow < grid->rows ? grid->originY + (double)endRow * grid->cellSize - y : INFINITY;
+
+    return fmin(fmin(left, right), fmin(top, bottom));
+}
+
+/**
+ * @brief Find the seed closest to a point by visiting rings of grid cells
+ * around it until no unvisited cell can hold a closer seed
+ * 
+ * @param grid 
+ * @param x 
+ * @param y 
+ * @return uint32_t 
+ */
+uint32_t NearestSeed(const SeedGrid *grid, double x, double y) 
+{
+    int col, row;
+    ClampGridCell(grid, x, y, &col, &row);
+    uint32_t closestSeedIdx = 0;
+    double closestDist = INFINITY;
+
+    for (int ring = 0; ; ++ring) {
+        int beginCol = col - ring, endCol = col + ring;
+        int beginRow = row - ring, endRow = row + ring;
+
+        if (beginCol < -1 && beginRow < -1 && endCol > grid->cols && endRow > grid->rows) {
+            break;
+        }
+        if (ring > 0) {
+            double reach = RingReach(grid, x, y, beginCol, endCol, beginRow, endRow);
+
+            if (reach > 0 && closestDist < reach * reach) {
+                break;
+            }
+        }
+
+        for (int r = beginRow; r <= endRow; ++r) {
+            if (r < 0 || r >= grid->rows) {
+                continue;
+            }
+            int step = (r == beginRow || r == endRow || ring == 0) ? 1 : endCol - beginCol;
+
+            for (int c = beginCol; c <= endCol; c += step) {
+                if (c < 0 || c >= grid->cols) {
+                    continue;
+                }
+                size_t cell = (size_t)r * grid->cols + c;
+
+                for (uint32_t i = grid->cellStart[cell]; i < grid->cellStart[cell + 1]; ++i) {
+                    uint32_t seedIdx = grid->cellSeeds[i];
+                    double dx = grid->points[seedIdx].x - x;
+                    double dy = grid->points[seedIdx].y - y;
+                    double currDist = dx * dx + dy * dy;
+
+                    if (currDist < closestDist || (currDist == closestDist && seedIdx < closestSeedIdx)) {
+                        closestDist = currDist;
+                        closestSeedIdx = seedIdx;
+                    }
+                }
+            }
+        }
+    }
+
+    return closestSeedIdx;
+}
+
+/**
+ * @brief Find the two seeds closest to a point, the second one being the
+ * closest at a different position than the first. Ties go to the lower
+ * index. The second index is LABEL_NONE when all seeds share one position.
+ * 
+ * @param grid 
+ * @param x 
+ * @param y 
+ * @param seedIdxs 
+ * @return * Find 
+ */
+void NearestTwoSeeds(const SeedGrid *grid, double x, double y, uint32_t *seedIdxs) 
+{
+    int col, row;
+    ClampGridCell(grid, x, y, &col, &row);
+    double closestDist = INFINITY, secondDist = INFINITY;
+
+    seedIdxs[0] = seedIdxs[1] = LABEL_NONE;
+
+    for (int ring = 0; ; ++ring) {
+        int beginCol = col - ring, endCol = col + ring;
+        int beginRow = row - ring, endRow = row + ring;
+
+        if (beginCol < -1 && beginRow < -1 && endCol > grid->cols && endRow > grid->rows) {
+            break;
+        }
+        if (ring > 0) {
+            double reach = RingReach(grid, x, y, beginCol, endCol, beginRow, endRow);
+
+            if (reach > 0 && secondDist < reach * reach) {
+                break;
+            }
+        }
+
+        for (int r = beginRow; r <= endRow; ++r) {
+            if (r < 0 || r >= grid->rows) {
+                continue;
+            }
+            int step = (r == beginRow || r == endRow || ring == 0) ? 1 : endCol - beginCol;
+
+            for (int c = beginCol; c <= endCol; c += step) {
+                if (c < 0 || c >= grid->cols) {
+                    continue;
+                }
+                size_t cell = (size_t)r * grid->cols + c;
+
+                for (uint32_t i = grid->cellStart[cell]; i < grid->cellStart[cell + 1]; ++i) {
+                    uint32_t seedIdx = grid->cellSeeds[i];
+                    Vec2 seed = grid->points[seedIdx];
+                    double currDist = (seed.x - x) * (seed.x - x) + (seed.y - y) * (seed.y - y);
+
+                    if (currDist < closestDist || (currDist == closestDist && seedIdx < seedIdxs[0])) {
+                        Vec2 closest = seedIdxs[0] != LABEL_NONE ? grid->points[seedIdxs[0]] : seed;
+
+                        if (closest.x != seed.x || closest.y != seed.y) {
+                            secondDist = closestDist;
+                            seedIdxs[1] = seedIdxs[0];
+                        }
+                        closestDist = currDist;
+                        seedIdxs[0] = seedIdx;
+                    } else if ((currDist < secondDist || (currDist == secondDist && seedIdx < seedIdxs[1]))
+                               && (seed.x != grid->points[seedIdxs[0]].x || seed.y != grid->points[seedIdxs[0]].y)) {
+                        secondDist = currDist;
+                        seedIdxs[1] = seedIdx;
+                    }
+                }
+            }
+        }
+    }
+}
+
+/**
+ * @brief Find the closest seed for a batch of query points, splitting the
+ * batch across threads. Query coordinates must be finite.
+ * 
+ * @param grid 
+ * @param queries 
+ * @param count 
+ * @param seedIdxs 
+ * @return * Query 
+ */
+void QueryNearestSeeds(const SeedGrid *grid, const Vec2f *queries, size_t count, uint32_t *seedIdxs) 
+{
+    #pragma omp parallel for schedule(static, 1024)
+    for (size_t i = 0; i < count; ++i) {
+        seedIdxs[i] = NearestSeed(grid, queries[i].x, queries[i].y);
+    }
+}
+
+/**
+ * @brief Answer a stream of query points, read as float x y pairs, with the
+ * index of their closest seed, written as uint32 values
+ * 
+ * @param grid 
+ * @param queriesPath 
+ * @param resultsPath 
+ * @return * Stream 
+ */
+void StreamNearestSeedQueries(const SeedGrid *grid, const char *queriesPath, const char *resultsPath) 
+{
+    FILE *queriesFile = fopen(queriesPath, "rb");
+    if (queriesFile == NULL) {
+        fprintf(stderr, "ERROR: cannot read file %s: %s\n", queriesPath, strerror(errno));
+        exit(1);
+    }
+    FILE *resultsFile = fopen(resultsPath, "wb");
+    if (resultsFile == NULL) {
+        fprintf(stderr, "ERROR: cannot write into file %s: %s\n", resultsPath, strerror(errno));
+        exit(1);
+    }
+
+    Vec2f *queries = malloc(QUERY_BATCH_SIZE * sizeof(Vec2f));
+    uint32_t *seedIdxs = malloc(QUERY_BATCH_SIZE * sizeof(uint32_t));
+    assert(queries != NULL && seedIdxs != NULL);
+
+    size_t count;
+    uint64_t queried = 0;
+    while ((count = fread(queries, sizeof(Vec2f), QUERY_BATCH_SIZE, queriesFile)) > 0) {
+        for (size_t i = 0; i < count; ++i) {
+            if (!isfinite(queries[i].x) || !isfinite(queries[i].y)) {
+                fprintf(stderr, "ERROR: query %llu in %s is not a finite point\n", (unsigned long long)(queried + i), queriesPath);
+                exit(1);
+            }
+        }
+        queried += count;
+        QueryNearestSeeds(grid, queries, count, seedIdxs);
+        fwrite(seedIdxs, sizeof(uint32_t), count, resultsFile);
+        assert(!ferror(resultsFile));
+    }
+    assert(!ferror(queriesFile));
+
+    free(queries);
+    free(seedIdxs);
+    fclose(queriesFile);
+    int err = fclose(resultsFile);
+    assert(err == 0);
+}
+
+/**
+ * @brief Collect the indices of all seeds within a radius of a point. At most
+ * maxCount indices are written, but the full count is returned.
+ * 
+ * @param grid 
+ * @param x 
+ * @param y 
+ * @param radius 
+ * @param seedIdxs 
+ * @param maxCount 
+ * @return size_t 
+ */
+size_t GatherSeeds(const SeedGrid *grid, double x, double y, double radius, uint32_t *seedIdxs, size_t maxCount) 
+{
+    int beginCol = (int)floor((x - radius - grid->originX) / grid->cellSize);
+    int endCol = (int)floor((x + radius - grid->originX) / grid->cellSize);
+    int beginRow = (int)floor((y - radius - grid->originY) / grid->cellSize);
+    int endRow = (int)floor((y + radius - grid->originY) / grid->cellSize);
+    beginCol = beginCol < 0 ? 0 : beginCol;
+    beginRow = beginRow < 0 ? 0 : beginRow;
+    endCol = endCol < grid->cols ? endCol : grid->cols - 1;
+    endRow = endRow < grid->rows ? endRow : grid->rows - 1;
+
+    size_t count = 0;
+    for (int row = beginRow; row <= endRow; ++row) {
+        for (int col = beginCol; col <= endCol; ++col) {
+            size_t cell = (size_t)row * grid->cols + col;
+
+            for (uint32_t i = grid->cellStart[cell]; i < grid->cellStart[cell + 1]; ++i) {
+                uint32_t seedIdx = grid->cellSeeds[i];
+                double dx = grid->points[seedIdx].x - x;
+                double dy = grid->points[seedIdx].y - y;
+
+                if (dx * dx + dy * dy <= radius * radius) {
+                    if (count < maxCount) {
+                        seedIdxs[count] = seedIdx;
+                    }
+                    ++count;
+                }
+            }
+        }
+    }
+
+    return count;
+}
+
+int CompareSeedIdxs(const void *a, const void *b) 
+{
+    uint32_t lf = *(const uint32_t *)a;
+    uint32_t rg = *(const uint32_t *)b;
+
+    return (lf > rg) - (lf < rg);
+}
+
+/**
+ * @brief Collect the seeds whose cells can reach into a tile: any seed further
+ * from the tile centre than the closest one plus the tile's diagonal cannot
+ * win a pixel of the tile. Returns 0 if the list does not fit.
+ * 
+ * @param grid 
+ * @param tileX 
+ * @param tileY 
+ * @param tileSize 
+ * @param seedIdxs 
+ * @return size_t 
+ */
+size_t GatherTileCandidates(const SeedGrid *grid, int tileX, int tileY, int tileSize, uint32_t *seedIdxs) 
+{
+    int tileWidth = tileX + tileSize < WIDTH ? tileSize : WIDTH - tileX;
+    int tileHeight = tileY + tileSize < HEIGHT ? tileSize : HEIGHT - tileY;
+    double centreX = tileX + (tileWidth - 1) * 0.5;
+    double centreY = tileY + (tileHeight - 1) * 0.5;
+    double halfDiagonal = sqrt((tileWidth - 1) * (tileWidth - 1) + (tileHeight - 1) * (tileHeight - 1)) * 0.5;
+
+    Vec2 closest = grid->points[NearestSeed(grid, centreX, centreY)];
+    double closestDist = sqrt((closest.x - centreX) * (closest.x - centreX) + (closest.y - centreY) * (closest.y - centreY));
+    double radius = closestDist + 2 * halfDiagonal + 1e-6;
+
+    size_t count = GatherSeeds(grid, centreX, centreY, radius, seedIdxs, TILE_MAX_CANDIDATES);
+    if (count > TILE_MAX_CANDIDATES) {
+        return 0;
+    }
+
+    qsort(seedIdxs, count, sizeof(uint32_t), CompareSeedIdxs);
+    return count;
+}
+
+/**
+ * @brief Collect the seeds that can be closest or second closest anywhere in
+ * a tile: the second closest distance moves by at most the distance to the
+ * tile centre, so the radius is the centre's second closest distance plus
+ * the tile's diagonal. Returns 0 if the list does not fit.
+ * 
+ * @param grid 
+ * @param tileX 
+ * @param tileY 
+ * @param tileSize 
+ * @param seedIdxs 
+ * @return size_t 
+ */
+size_t GatherTileEdgeCandidates(const SeedGrid *grid, int tileX, int tileY, int tileSize, uint32_t *seedIdxs) 
+{
+    int tileWidth = tileX + tileSize < WIDTH ? tileSize : WIDTH - tileX;
+    int tileHeight = tileY + tileSize < HEIGHT ? tileSize : HEIGHT - tileY;
+    double centreX = tileX + (tileWidth - 1) * 0.5;
+    double centreY = tileY + (tileHeight - 1) * 0.5;
+    double halfDiagonal = sqrt((tileWidth - 1) * (tileWidth - 1) + (tileHeight - 1) * (tileHeight - 1)) * 0.5;
+    uint32_t nearest[2];
+
+    NearestTwoSeeds(grid, centreX, centreY, nearest);
+    if (nearest[1] == LABEL_NONE) {
+        return 0;
+    }
+
+    Vec2 second = grid->points[nearest[1]];
+    double secondDist = sqrt((second.x - centreX) * (second.x - centreX) + (second.y - centreY) * (second.y - centreY));
+    double radius = secondDist + 2 * halfDiagonal + 1e-6;
+
+    size_t count = GatherSeeds(grid, centreX, centreY, radius, seedIdxs, TILE_MAX_CANDIDATES);
+    if (count > TILE_MAX_CANDIDATES) {
+        return 0;
+    }
+
+    qsort(seedIdxs, count, sizeof(uint32_t), CompareSeedIdxs);
+    return count;
+}
+
+/**
+ * @brief Append a span of in-domain pixels to the row being built. Rows must
+ * be built in order, each closed with EndMaskRow.
+ * 
+ * @param mask 
+ * @param begin 
+ * @param end 
+ * @return * Add 
+ */
+void AddMaskSpan(DomainMask *mask, int begin, int end) 
+{
+    begin = begin < 0 ? 0 : begin;
+    end = end < WIDTH ? end : WIDTH;
+    if (begin >= end) {
+        return;
+    }
+
+    if (mask->count == mask->capacity) {
+        mask->capacity = mask->capacity > 0 ? 2 * mask->capacity : HEIGHT;
+        mask->spans = realloc(mask->spans, mask->capacity * sizeof(Span));
+        assert(mask->spans != NULL);
+    }
+    mask->spans[mask->count++] = (Span){begin, end};
+}
+
+void EndMaskRow(DomainMask *mask, int y) 
+{
+    mask->rowStart[y + 1] = mask->count;
+}
+
+/**
+ * @brief Skip whitespace and comments in a netpbm header, then read a number
+ * 
+ * @param file 
+ * @return int 
+ */
+int ReadPBMNumber(FILE *file) 
+{
+    int c = fgetc(file);
+    while (c == '#' || c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+        if (c == '#') {
+            while (c != '\n' && c != EOF) {
+                c = fgetc(file);
+            }
+        }
+        c = fgetc(file);
+    }
+
+    int value = -1;
+    while ('0' <= c && c <= '9') {
+        value = (value < 0 ? 0 : value * 10) + (c - '0');
+        c = fgetc(file);
+    }
+    return value;
+}
+
+/**
+ * @brief Load the domain mask from a PBM bitmap (P1 or P4) the size of the
+ * image. Black pixels are inside the domain.
+ * 
+ * @param mask 
+ * @param file 
+ * @param filePath 
+ * @return * Load 
+ */
+void LoadMaskPBM(DomainMask *mask, FILE *file, const char *filePath) 
+{
+    char magic[2];
+    if (fread(magic, 1, 2, file) != 2 || magic[0] != 'P' || (magic[1] != '1' && magic[1] != '4')) {
+        fprintf(stderr, "ERROR: file %s is not a PBM bitmap\n", filePath);
+        exit(1);
+    }
+
+    int width = ReadPBMNumber(file);
+    int height = ReadPBMNumber(file);
+    if (width != WIDTH || height != HEIGHT) {
+        fprintf(stderr, "ERROR: mask %s is %dx%d, expected %dx%d\n", filePath, width, height, WIDTH, HEIGHT);
+        exit(1);
+    }
+
+    static uint8_t row[(WIDTH + 7) / 8];
+    for (int y = 0; y < HEIGHT; ++y) {
+        if (magic[1] == '4') {
+            if (fread(row, sizeof(row), 1, file) != 1) {
+                fprintf(stderr, "ERROR: mask %s is truncated\n", filePath);
+                exit(1);
+            }
+        } else {
+            memset(row, 0, sizeof(row));
+            for (int x = 0; x < WIDTH; ++x) {
+                int c = fgetc(file);
+                while (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+                    c = fgetc(file);
+                }
+                if (c == '1') {
+                    row[x / 8] |= 0x80 >> (x % 8);
+                }
+            }
+        }
+
+        int begin = -1;
+        for (int x = 0; x <= WIDTH; ++x) {
+            int inside = x < WIDTH && (row[x / 8] & (0x80 >> (x % 8)));
+            if (inside && begin < 0) {
+                begin = x;
+            } else if (!inside && begin >= 0) {
+                AddMaskSpan(mask, begin, x);
+                begin = -1;
+            }
+        }
+        EndMaskRow(mask, y);
+    }
+}
+
+int CompareDoubles(const void *a, const void *b) 
+{
+    double lf = *(const double *)a;
+    double rg = *(const double *)b;
+
+    return (lf > rg) - (lf < rg);
+}
+
+/**
+ * @brief Load the domain mask from a text file of polygon vertices, one x y
+ * pair per line, with blank lines separating rings. Rings are filled with the
+ * even-odd rule, a pixel being inside when its integer position is.
+ * 
+ * @param mask 
+ * @param file 
+ * @param filePath 
+ * @return * Load 
+ */
+void LoadMaskPolygon(DomainMask *mask, FILE *file, const char *filePath) 
+{
+    Vec2d *vertices = NULL;
+    size_t *ringEnds = NULL;
+    size_t verticesCount = 0, ringsCount = 0, capacity = 0;
+    char line[256];
+
+    for (int more = 1; more; ) {
+        more = fgets(line, sizeof(line), file) != NULL;
+
+        Vec2d vertex;
+        if (more && sscanf(line, "%lf %lf", &vertex.x, &vertex.y) == 2) {
+            if (verticesCount == capacity) {
+                capacity = capacity > 0 ? 2 * capacity : 64;
+                vertices = realloc(vertices, capacity * sizeof(Vec2d));
+                ringEnds = realloc(ringEnds, capacity * sizeof(size_t));
+                assert(vertices != NULL && ringEnds != NULL);
+            }
+            vertices[verticesCount++] = vertex;
+        } else if (verticesCount > (ringsCount > 0 ? ringEnds[ringsCount - 1] : 0)) {
+            ringEnds[ringsCount++] = verticesCount;
+        }
+    }
+
+    if (ringsCount == 0) {
+        fprintf(stderr, "ERROR: file %s holds no polygon\n", filePath);
+        exit(1);
+    }
+
+    double *crossings = malloc(verticesCount * sizeof(double));
+    assert(crossings != NULL);
+
+    for (int y = 0; y < HEIGHT; ++y) {
+        size_t crossingsCount = 0;
+
+        for (size_t ring = 0, first = 0; ring < ringsCount; first = ringEnds[ring++]) {
+            for (size_t i = first; i < ringEnds[ring]; ++i) {
+                Vec2d a = vertices[i];
+                Vec2d b = vertices[i + 1 < ringEnds[ring] ? i + 1 : first];
+
+                if ((a.y <= y && y < b.y) || (b.y <= y && y < a.y)) {
+                    crossings[crossingsCount++] = a.x + (y - a.y) * (b.x - a.x) / (b.y - a.y);
+                }
+            }
+        }
+
+        qsort(crossings, crossingsCount, sizeof(double), CompareDoubles);
+        for (size_t i = 0; i + 1 < crossingsCount; i += 2) {
+            double begin = fmax(ceil(crossings[i]), 0);
+            double end = fmin(ceil(crossings[i + 1]), WIDTH);
+            if (begin < end) {
+                AddMaskSpan(mask, (int)begin, (int)end);
+            }
+        }
+        EndMaskRow(mask, y);
+    }
+
+    free(crossings);
+    free(vertices);
+    free(ringEnds);
+}
+
+/**
+ * @brief Load the domain mask from a PBM bitmap or a polygon file, told apart
+ * by the netpbm magic
+ * 
+ * @param mask 
+ * @param filePath 
+ * @return * Load 
+ */
+void LoadDomainMask(DomainMask *mask, const char *filePath) 
+{
+    FILE *file = fopen(filePath, "rb");
+
+    if (file == NULL) {
+        fprintf(stderr, "ERROR: cannot read file %s: %s\n", filePath, strerror(errno));
+        exit(1);
+    }
+
+    memset(mask, 0, sizeof(*mask));
+
+    int c = fgetc(file);
+    ungetc(c, file);
+    if (c == 'P') {
+        LoadMaskPBM(mask, file, filePath);
+    } else {
+        LoadMaskPolygon(mask, file, filePath);
+    }
+    fclose(file);
+}
+
+void FreeDomainMask(DomainMask *mask) 
+{
+    free(mask->spans);
+    mask->spans = NULL;
+}
+
+/**
+ * @brief Check whether any pixel of a rectangle is inside the domain
+ * 
+ * @param mask 
+ * @param beginX 
+ * @param beginY 
+ * @param endX 
+ * @param endY 
+ * @return int 
+ */
+int MaskTouchesRect(const DomainMask *mask, int beginX, int beginY, int endX, int endY) 
+{
+    for (int y = beginY; y < endY; ++y) {
+        for (uint32_t i = mask->rowStart[y]; i < mask->rowStart[y + 1]; ++i) {
+            if (mask->spans[i].begin < endX && mask->spans[i].end > beginX) {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Pick a tile size of about two seed spacings, so that the candidate
+ * list of a tile stays at a few dozen seeds whatever the seed density
+ * 
+ * @param grid 
+ * @return int 
+ */
+int TileSizeForGrid(const SeedGrid *grid) 
+{
+    double spacing = grid->cellSize * sqrt((double)grid->cols * grid->rows / grid->count);
+    int tileSize = (int)(2 * spacing);
+
+    tileSize = tileSize < TILE_SIZE ? tileSize : TILE_SIZE;
+    return tileSize > TILE_MIN_SIZE ? tileSize : TILE_MIN_SIZE;
+}
+
+/**
+ * @brief Render the rows from beginY to endY of the Voronoi diagram of the
+ * seeds held by a grid into a band of labels, WIDTH labels per row. Every
+ * tile only scans the short list of seeds that can reach into it.
+ * With a mask, tiles outside the domain are skipped and only in-domain spans
+ * are labelled; the rest of the band is left untouched.
+ * 
+ * @param grid 
+ * @param mask 
+ * @param beginY 
+ * @param bandEndY 
+ * @param bandLabels 
+ * @return * Render 
+ */
+void RenderBandWithGrid(const SeedGrid *grid, const DomainMask *mask, int beginY, int bandEndY, uint32_t *bandLabels) 
+{
+    int tileSize = TileSizeForGrid(grid);
+    int tilesX = (WIDTH + tileSize - 1) / tileSize;
+    int tilesY = (bandEndY - beginY + tileSize - 1) / tileSize;
+
+    #pragma omp parallel for schedule(dynamic)
+    for (int tile = 0; tile < tilesX * tilesY; ++tile) {
+        uint64_t tileBegin = progress.enabled ? NowNanos() : 0;
+        TileBuffer *buffer = PoolAlloc(ThreadTilePool(), sizeof(TileBuffer));
+        uint32_t *seedIdxs = buffer->seedIdxs;
+        int *candidatesX = buffer->candidatesX;
+        int *candidatesY = buffer->candidatesY;
+        int tileX = tile % tilesX * tileSize;
+        int tileY = beginY + tile / tilesX * tileSize;
+        int endX = tileX + tileSize < WIDTH ? tileX + tileSize : WIDTH;
+        int endY = tileY + tileSize < bandEndY ? tileY + tileSize : bandEndY;
+
+        if (mask != NULL && !MaskTouchesRect(mask, tileX, tileY, endX, endY)) {
+            PoolFree(ThreadTilePool(), buffer);
+            if (progress.enabled) {
+                ProgressTile((uint64_t)(endX - tileX) * (endY - tileY), 0);
+            }
+            continue;
+        }
+
+        size_t count = GatherTileCandidates(grid, tileX, tileY, tileSize, seedIdxs);
+
+        for (size_t i = 0; i < count; ++i) {
+            candidatesX[i] = grid->points[seedIdxs[i]].x;
+            candidatesY[i] = grid->points[seedIdxs[i]].y;
+        }
+
+        for (int y = tileY; y < endY; ++y) {
+            uint32_t *rowLabels = &bandLabels[(size_t)(y - beginY) * WIDTH];
+            Span row = {tileX, endX};
+            const Span *spans = &row;
+            size_t spansCount = 1;
+
+            if (mask != NULL) {
+                spans = &mask->spans[mask->rowStart[y]];
+                spansCount = mask->rowStart[y + 1] - mask->rowStart[y];
+            }
+
+            for (size_t s = 0; s < spansCount; ++s) {
+                int beginX = spans[s].begin > tileX ? spans[s].begin : tileX;
+                int spanEndX = spans[s].end < endX ? spans[s].end : endX;
+
+                for (int x = beginX; x < spanEndX; ++x) {
+                    if (count == 0) {
+                        rowLabels[x] = NearestSeed(grid, x, y);
+                        continue;
+                    }
+
+                    size_t closestIdx = 0;
+                    int closestDist = INT32_MAX;
+
+                    for (size_t i = 0; i < count; ++i) {
+                        int dx = candidatesX[i] - x;
+                        int dy = candidatesY[i] - y;
+                        int currDist = dx * dx + dy * dy;
+
+                        if (currDist < closestDist) {
+                            closestDist = currDist;
+                            closestIdx = i;
+                        }
+                    }
+
+                    rowLabels[x] = seedIdxs[closestIdx];
+                }
+            }
+        }
+
+        PoolFree(ThreadTilePool(), buffer);
+        if (progress.enabled) {
+            ProgressTile((uint64_t)(endX - tileX) * (endY - tileY), NowNanos() - tileBegin);
+        }
+    }
+}
+
+/**
+ * @brief Render the Voronoi diagram of the seeds held by a grid into the label
+ * buffer, see RenderBandWithGrid
+ * 
+ * @param grid 
+ * @param mask 
+ * @return * Render 
+ */
+void RenderVoronoiWithGrid(const SeedGrid *grid, const DomainMask *mask) 
+{
+    RenderBandWithGrid(grid, mask, 0, HEIGHT, &labels[0][0]);
+}
+
+/**
+ * @brief Generate the Voronoi algorithm and render it into the label buffer
+ * 
+ * @return * Generate 
+ */
+void RenderVoronoi()
+{
+    Arena *arena = ThreadArena();
+    size_t mark = arena->used;
+    SeedGrid grid;
+
+    ProgressStage(STAGE_INDEX);
+    BuildSeedGrid(&grid, seeds, SEEDS_COUNT, arena);
+    ProgressStage(STAGE_RENDER);
+    RenderVoronoiWithGrid(&grid, NULL);
+    ArenaRewind(arena, mark);
+}
+
+/**
+ * @brief Label a block of pixels for a bounded-error preview. The candidates
+ * must hold the closest seed of every pixel of the block. With d the closest
+ * candidate distance at the block centre and h its half-diagonal, every pixel
+ * is within d + h of that seed and at least d - h from any seed, so the whole
+ * block takes it once d + h <= (1 + epsilon) (d - h). Otherwise the candidates
+ * within d + 2h of the centre, which still hold every closest seed, are split
+ * over four sub-blocks, down to a per-pixel scan of small blocks.
+ * 
+ * @param candidatesX 
+ * @param candidatesY 
+ * @param seedIdxs 
+ * @param count 
+ * @param beginX 
+ * @param beginY 
+ * @param endX 
+ * @param endY 
+ * @param epsilon 
+ * @return * Render 
+ */
+void RenderApproximateBlock(const int *candidatesX, const int *candidatesY, const uint32_t *seedIdxs, size_t count, int beginX, int beginY, int endX, int endY, double epsilon) 
+{
+    double centreX = (beginX + endX - 1) * 0.5;
+    double centreY = (beginY + endY - 1) * 0.5;
+    double halfDiagonal = hypot(endX - beginX - 1, endY - beginY - 1) * 0.5;
+    size_t closestIdx = 0;
+    double closestDist = INFINITY;
+
+    for (size_t i = 0; i < count; ++i) {
+        double dx = candidatesX[i] - centreX;
+        double dy = candidatesY[i] - centreY;
+        double currDist = dx * dx + dy * dy;
+
+        if (currDist < closestDist) {
+            closestDist = currDist;
+            closestIdx = i;
+        }
+    }
+    closestDist = sqrt(closestDist);
+
+    if (closestDist > halfDiagonal && closestDist + halfDiagonal <= (1 + epsilon) * (closestDist - halfDiagonal)) {
+        for (int y = beginY; y < endY; ++y) {
+            for (int x = beginX; x < endX; ++x) {
+                labels[y][x] = seedIdxs[closestIdx];
+            }
+        }
+        return;
+    }
+
+    if ((endX - beginX) * (endY - beginY) <= APPROXIMATE_MIN_BLOCK * APPROXIMATE_MIN_BLOCK) {
+        for (int y = beginY; y < endY; ++y) {
+            for (int x = beginX; x < endX; ++x) {
+                size_t pixelIdx = 0;
+                int pixelDist = INT32_MAX;
+
+                for (size_t i = 0; i < count; ++i) {
+                    int dx = candidatesX[i] - x;
+                    int dy = candidatesY[i] - y;
+                    int currDist = dx * dx + dy * dy;
+
+                    if (currDist < pixelDist) {
+                        pixelDist = currDist;
+                        pixelIdx = i;
+                    }
+                }
+                labels[y][x] = seedIdxs[pixelIdx];
+            }
+        }
+        return;
+    }
+
+    int subX[TILE_MAX_CANDIDATES], subY[TILE_MAX_CANDIDATES];
+    uint32_t subIdxs[TILE_MAX_CANDIDATES];
+    double radius = closestDist + 2 * halfDiagonal + 1e-6;
+    size_t subCount = 0;
+
+    for (size_t i = 0; i < count; ++i) {
+        double dx = candidatesX[i] - centreX;
+        double dy = candidatesY[i] - centreY;
+
+        if (dx * dx + dy * dy <= radius * radius) {
+            subX[subCount] = candidatesX[i];
+            subY[subCount] = candidatesY[i];
+            subIdxs[subCount++] = seedIdxs[i];
+        }
+    }
+
+    int middleX = (beginX + endX) / 2;
+    int middleY = (beginY + endY) / 2;
+    RenderApproximateBlock(subX, subY, subIdxs, subCount, beginX, beginY, middleX, middleY, epsilon);
+    RenderApproximateBlock(subX, subY, subIdxs, subCount, middleX, beginY, endX, middleY, epsilon);
+    RenderApproximateBlock(subX, subY, subIdxs, subCount, beginX, middleY, middleX, endY, epsilon);
+    RenderApproximateBlock(subX, subY, subIdxs, subCount, middleX, middleY, endX, endY, epsilon);
+}
+
+/**
+ * @brief Render a preview into the label buffer where every pixel gets a seed
+ * at most 1 + epsilon times further than its closest one. Tiles gather their
+ * exact candidates, then RenderApproximateBlock fills the parts of the tile
+ * where one seed is good enough without searching their pixels. With
+ * epsilon 0 the result is exact.
+ * 
+ * @param grid 
+ * @param epsilon 
+ * @return * Render 
+ */
+void RenderVoronoiApproximateWithGrid(const SeedGrid *grid, double epsilon) 
+{
+    int tileSize = TileSizeForGrid(grid);
+    int tilesX = (WIDTH + tileSize - 1) / tileSize;
+    int tilesY = (HEIGHT + tileSize - 1) / tileSize;
+
+    #pragma omp parallel for schedule(dynamic)
+    for (int tile = 0; tile < tilesX * tilesY; ++tile) {
+        TileBuffer *buffer = PoolAlloc(ThreadTilePool(), sizeof(TileBuffer));
+        uint32_t *seedIdxs = buffer->seedIdxs;
+        int *candidatesX = buffer->candidatesX;
+        int *candidatesY = buffer->candidatesY;
+        int tileX = tile % tilesX * tileSize;
+        int tileY = tile / tilesX * tileSize;
+        int endX = tileX + tileSize < WIDTH ? tileX + tileSize : WIDTH;
+        int endY = tileY + tileSize < HEIGHT ? tileY + tileSize : HEIGHT;
+        size_t count = GatherTileCandidates(grid, tileX, tileY, tileSize, seedIdxs);
+
+        if (count == 0) {
+            for (int y = tileY; y < endY; ++y) {
+                for (int x = tileX; x < endX; ++x) {
+                    labels[y][x] = NearestSeed(grid, x, y);
+                }
+            }
+            PoolFree(ThreadTilePool(), buffer);
+            continue;
+        }
+
+        for (size_t i = 0; i < count; ++i) {
+            candidatesX[i] = grid->points[seedIdxs[i]].x;
+            candidatesY[i] = grid->points[seedIdxs[i]].y;
+        }
+        RenderApproximateBlock(candidatesX, candidatesY, seedIdxs, count, tileX, tileY, endX, endY, epsilon);
+
+        PoolFree(ThreadTilePool(), buffer);
+    }
+}
+
+/**
+ * @brief Render a bounded-error preview into the label buffer, see
+ * RenderVoronoiApproximateWithGrid
+ * 
+ * @param epsilon 
+ * @return * Render 
+ */
+void RenderVoronoiApproximate(double epsilon) 
+{
+    Arena *arena = ThreadArena();
+    size_t mark = arena->used;
+    SeedGrid grid;
+
+    BuildSeedGrid(&grid, seeds, SEEDS_COUNT, arena);
+    RenderVoronoiApproximateWithGrid(&grid, epsilon);
+    ArenaRewind(arena, mark);
+}
+
+/**
+ * @brief Parse a positive byte count with an optional K, M or G suffix. Any
+ * other text is an error.
+ * 
+ * @param text 
+ * @return size_t 
+ */
+size_t ParseByteSize(const char *text) 
+{
+    char *end;
+    double value = strtod(text, &end);
+
+    const char *suffix = end;
+
+    switch (*suffix) {
+    case 'G': case 'g': value *= 1024;  /* fall through */
+    case 'M': case 'm': value *= 1024;  /* fall through */
+    case 'K': case 'k': value *= 1024;
+        ++suffix;
+    }
+    if (end == text || *suffix != '\0' || !(value >= 1 && value < (double)SIZE_MAX)) {
+        fprintf(stderr, "ERROR: invalid byte size %s, expected a positive number with an optional K, M or G suffix\n", text);
+        exit(1);
+    }
+    return (size_t)value;
+}
+
+/**
+ * @brief Parse a count between min and max. Negative numbers, any other text
+ * and counts out of range are an error.
+ * 
+ * @param text 
+ * @param min 
+ * @param max 
+ * @return uint64_t 
+ */
+uint64_t ParseCount(const char *text, uint64_t min, uint64_t max) 
+{
+    char *end;
+    errno = 0;
+    unsigned long long value = strtoull(text, &end, 10);
+
+    if (text[0] < '0' || text[0] > '9' || *end != '\0' || errno == ERANGE || value < min || value > max) {
+        fprintf(stderr, "ERROR: invalid count %s, expected a whole number between %llu and %llu\n", text,
+                (unsigned long long)min, (unsigned long long)max);
+        exit(1);
+    }
+    return value;
+}
+
+/**
+ * @brief Choose how to render within a memory budget. The whole image is kept
+ * in memory when it fits next to the grid. Otherwise the image is rendered in
+ * bands of rows that are streamed to the file, as tall as the budget allows.
+ * When not even a single row fits, a coarser grid index and then fewer
+ * threads, each holding its own tile buffers, are tried.
+ * 
+ * @param budget 
+ * @param plan 
+ * @return * Plan 
+ */
+void PlanRender(size_t budget, RenderPlan *plan) 
+{
+    static const int densities[] = {SEED_GRID_DENSITY, 4 * SEED_GRID_DENSITY, 16 * SEED_GRID_DENSITY};
+    size_t fixedBytes = PLAN_BASE_BYTES + sizeof(seeds);
+    size_t rowBytes = WIDTH * (sizeof(uint32_t) + 3);
+    int maxThreads = 1;
+
+#ifdef _OPENMP
+    maxThreads = omp_get_max_threads();
+#endif
+    maxThreads = maxThreads < MAX_THREADS ? maxThreads : MAX_THREADS;
+
+    for (int threads = maxThreads; threads >= 1; threads /= 2) {
+        for (size_t i = 0; i < sizeof(densities) / sizeof(densities[0]); ++i) {
+            memset(plan, 0, sizeof(*plan));
+            plan->budgetBytes = budget;
+            plan->gridDensity = densities[i];
+            plan->threads = threads;
+            plan->indexBytes = (SEEDS_COUNT / densities[i] + 2) * sizeof(uint32_t) + SEEDS_COUNT * sizeof(uint32_t);
+            plan->tileCacheBytes = (size_t)threads * TILE_POOL_BLOCKS * sizeof(TileBuffer);
+
+            size_t baseBytes = fixedBytes + plan->indexBytes + plan->tileCacheBytes;
+
+            if (i == 0 && baseBytes + sizeof(image) + sizeof(labels) + BUFSIZ <= budget) {
+                plan->inMemory = 1;
+                plan->bandHeight = HEIGHT;
+                plan->bandBytes = sizeof(image) + sizeof(labels);
+                plan->encoderBytes = BUFSIZ;
+            } else if (baseBytes + rowBytes <= budget) {
+                int bandHeight = (budget - baseBytes) / rowBytes < HEIGHT ? (budget - baseBytes) / rowBytes : HEIGHT;
+
+                plan->bandHeight = bandHeight >= TILE_SIZE ? bandHeight / TILE_SIZE * TILE_SIZE : bandHeight;
+                plan->bandBytes = (size_t)plan->bandHeight * WIDTH * sizeof(uint32_t);
+                plan->encoderBytes = (size_t)plan->bandHeight * WIDTH * 3;
+            } else {
+                continue;
+            }
+
+            plan->totalBytes = baseBytes + plan->bandBytes + plan->encoderBytes;
+            return;
+        }
+    }
+
+    fprintf(stderr, "ERROR: a memory budget of %zu bytes cannot fit a single row of the image\n", budget);
+    exit(1);
+}
+
+/**
+ * @brief Print the chosen render plan
+ * 
+ * @param plan 
+ * @return * Report 
+ */
+void ReportRenderPlan(const RenderPlan *plan) 
+{
+    fprintf(stderr, "plan: %s, budget %zu KiB, estimated %zu KiB\n",
+            plan->inMemory ? "in-memory" : "streaming bands", plan->budgetBytes >> 10, plan->totalBytes >> 10);
+    fprintf(stderr, "  bands: %d rows, %zu KiB of labels\n", plan->bandHeight, plan->bandBytes >> 10);
+    fprintf(stderr, "  index: grid with %d seeds per cell, %zu KiB\n", plan->gridDensity, plan->indexBytes >> 10);
+    fprintf(stderr, "  tile cache: %d threads x %d tile buffers, %zu KiB\n", plan->threads, TILE_POOL_BLOCKS, plan->tileCacheBytes >> 10);
+    fprintf(stderr, "  encoder: %s, %zu KiB\n", plan->inMemory ? "stdio buffered" : "one unbuffered write per band", plan->encoderBytes >> 10);
+}
+
+/**
+ * @brief Print the peak resident memory of the process
+ * 
+ * @return * Report 
+ */
+void ReportPeakMemory() 
+{
+    struct rusage usage;
+
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        fprintf(stderr, "peak RSS: %ld KiB\n", usage.ru_maxrss);
+    }
+}
+
+/**
+ * @brief Encode rows of labels as PPM pixels, seed markers being LABEL_NONE
+ * 
+ * @param bandLabels 
+ * @param points 
+ * @param rows 
+ * @param bytes 
+ * @return * Encode 
+ */
+void EncodeLabelsPPM(const uint32_t *bandLabels, const Vec2 *points, int rows, uint8_t *bytes) 
+{
+    #pragma omp parallel for schedule(static)
+    for (int y = 0; y < rows; ++y) {
+        for (int x = 0; x < WIDTH; ++x) {
+            size_t pixelIdx = (size_t)y * WIDTH + x;
+            uint32_t label = bandLabels[pixelIdx];
+            Color pixel = label == LABEL_NONE ? SEED_MARKER_COLOR : SeedToColor(points[label]);
+
+            bytes[pixelIdx * 3 + 0] = (uint8_t)((pixel&0x0000FF) >> 8 * 0);
+            bytes[pixelIdx * 3 + 1] = (uint8_t)((pixel&0x00FF00) >> 8 * 1);
+            bytes[pixelIdx * 3 + 2] = (uint8_t)((pixel&0xFF0000) >> 8 * 2);
+        }
+    }
+}
+
+/**
+ * @brief Render the image band by band following a streaming plan, writing
+ * each band to the PPM file as soon as it is done, seed markers included.
+ * Neither the image nor the label buffer is touched.
+ * 
+ * @param plan 
+ * @param filePath 
+ * @return * Render 
+ */
+void RenderVoronoiBanded(const RenderPlan *plan, const char *filePath) 
+{
+    Arena *arena = ThreadArena();
+    size_t mark = arena->used;
+    SeedGrid grid;
+
+    ProgressStage(STAGE_INDEX);
+    BuildSeedGridSubset(&grid, seeds, NULL, SEEDS_COUNT, plan->gridDensity, arena);
+
+    uint32_t *bandLabels = malloc(plan->bandBytes);
+    uint8_t *bandBytes = malloc(plan->encoderBytes);
+    assert(bandLabels != NULL && bandBytes != NULL);
+
+    FILE *file = fopen(filePath, "wb");
+
+    if (file == NULL) {
+        fprintf(stderr, "ERROR: cannot write into file %s: %s\n", filePath, strerror(errno));
+        exit(1);
+    }
+    setvbuf(file, NULL, _IONBF, 0);
+    fprintf(file, "P6\n%d %d 255\n", WIDTH, HEIGHT);
+
+    for (int beginY = 0; beginY < HEIGHT; beginY += plan->bandHeight) {
+        int endY = beginY + plan->bandHeight < HEIGHT ? beginY + plan->bandHeight : HEIGHT;
+
+        ProgressStage(STAGE_RENDER);
+        RenderBandWithGrid(&grid, NULL, beginY, endY, bandLabels);
+
+        ProgressStage(STAGE_ENCODE);
+        int firstRow = (beginY - SEED_MARKER_RADIUS - grid.originY) / grid.cellSize;
+        int lastRow = (endY + SEED_MARKER_RADIUS - grid.originY) / grid.cellSize;
+        firstRow = firstRow > 0 ? firstRow : 0;
+        lastRow = lastRow < grid.rows ? lastRow : grid.rows - 1;
+
+        uint32_t firstSeed = firstRow <= lastRow ? grid.cellStart[(size_t)firstRow * grid.cols] : 0;
+        uint32_t endSeed = firstRow <= lastRow ? grid.cellStart[(size_t)(lastRow + 1) * grid.cols] : 0;
+
+        for (uint32_t i = firstSeed; i < endSeed; ++i) {
+            Vec2 origin = seeds[grid.cellSeeds[i]];
+
+            for (int y = origin.y - SEED_MARKER_RADIUS; y < origin.y + SEED_MARKER_RADIUS; ++y) {
+                for (int x = origin.x - SEED_MARKER_RADIUS; x < origin.x + SEED_MARKER_RADIUS; ++x) {
+                    Vec2 point = {x, y};
+
+                    if (beginY <= y && y < endY && 0 <= x && x < WIDTH
+                        && SquareDistance(origin, point) <= SEED_MARKER_RADIUS * SEED_MARKER_RADIUS) {
+                        bandLabels[(size_t)(y - beginY) * WIDTH + x] = LABEL_NONE;
+                    }
+                }
+            }
+        }
+
+        EncodeLabelsPPM(bandLabels, seeds, endY - beginY, bandBytes);
+
+        ProgressStage(STAGE_WRITE);
+        fwrite(bandBytes, (size_t)(endY - beginY) * WIDTH * 3, 1, file);
+        assert(!ferror(file));
+        ProgressBytes((uint64_t)(endY - beginY) * WIDTH * 3);
+    }
+
+    int err = fclose(file);
+    assert(err == 0);
+    free(bandLabels);
+    free(bandBytes);
+    ArenaRewind(arena, mark);
+}
+
+/**
+ * @brief Write random seeds to a file as int32 x y pairs, a chunk at a time so
+ * that the count is not limited by memory
+ * 
+ * @param count 
+ * @param filePath 
+ * @return * Generate 
+ */
+void GenerateSeedsFile(uint64_t count, const char *filePath) 
+{
+    FILE *file = fopen(filePath, "wb");
+
+    if (file == NULL) {
+        fprintf(stderr, "ERROR: cannot write into file %s: %s\n", filePath, strerror(errno));
+        exit(1);
+    }
+
+    Vec2 *chunk = malloc(OUT_OF_CORE_CHUNK_SEEDS * sizeof(Vec2));
+    assert(chunk != NULL);
+
+    for (uint64_t done = 0; done < count; ) {
+        size_t chunkCount = count - done < OUT_OF_CORE_CHUNK_SEEDS ? count - done : OUT_OF_CORE_CHUNK_SEEDS;
+        for (size_t i = 0; i < chunkCount; ++i) {
+            chunk[i].x = rand() % WIDTH;
+            chunk[i].y = rand() % HEIGHT;
+        }
+        fwrite(chunk, sizeof(Vec2), chunkCount, file);
+        assert(!ferror(file));
+        done += chunkCount;
+    }
+
+    free(chunk);
+    int err = fclose(file);
+    assert(err == 0);
+}
+
+/**
+ * @brief Read exactly size bytes at an offset of a file
+ * 
+ * @param fd 
+ * @param data 
+ * @param size 
+ * @param offset 
+ * @return * Read 
+ */
+void PreadAll(int fd, void *data, size_t size, off_t offset) 
+{
+    while (size > 0) {
+        ssize_t done = pread(fd, data, size, offset);
+
+        if (done < 0 && errno == EINTR) {
+            continue;
+        }
+        if (done <= 0) {
+            fprintf(stderr, "ERROR: cannot read seed bands: %s\n", done < 0 ? strerror(errno) : "truncated");
+            exit(1);
+        }
+        data = (uint8_t *)data + done;
+        size -= done;
+        offset += done;
+    }
+}
+
+/**
+ * @brief Write exactly size bytes at an offset of a file
+ * 
+ * @param fd 
+ * @param data 
+ * @param size 
+ * @param offset 
+ * @return * Write 
+ */
+void PwriteAll(int fd, const void *data, size_t size, off_t offset) 
+{
+    while (size > 0) {
+        ssize_t done = pwrite(fd, data, size, offset);
+
+        if (done < 0 && errno == EINTR) {
+            continue;
+        }
+        if (done <= 0) {
+            fprintf(stderr, "ERROR: cannot write seed bands: %s\n", strerror(errno));
+            exit(1);
+        }
+        data = (const uint8_t *)data + done;
+        size -= done;
+        offset += done;
+    }
+}
+
+/**
+ * @brief Get the band of rows a seed inside the image belongs to
+ * 
+ * @param y 
+ * @return size_t 
+ */
+size_t SeedBandOf(int32_t y) 
+{
+    return y / OUT_OF_CORE_BAND_HEIGHT;
+}
+
+/**
+ * @brief Sort a file of int32 x y pairs into bands of OUT_OF_CORE_BAND_HEIGHT
+ * rows on disk, with two streaming passes: the first counts the seeds of every
+ * band, the second appends every seed to its band through a small buffer per
+ * band. Every seed keeps its position in the input, and seeds within a band
+ * stay in input order. Seeds outside the image are rejected.
+ * 
+ * @param seedsPath 
+ * @param bandsPath Scratch file, removed once opened
+ * @param bands 
+ * @return * Sort 
+ */
+void SortSeedsIntoBands(const char *seedsPath, const char *bandsPath, SeedBands *bands) 
+{
+    FILE *input = fopen(seedsPath, "rb");
+
+    if (input == NULL) {
+        fprintf(stderr, "ERROR: cannot read file %s: %s\n", seedsPath, strerror(errno));
+        exit(1);
+    }
+
+    bands->bandsCount = (HEIGHT + OUT_OF_CORE_BAND_HEIGHT - 1) / OUT_OF_CORE_BAND_HEIGHT;
+    bands->bandStart = calloc(bands->bandsCount + 1, sizeof(uint64_t));
+    bands->fd = open(bandsPath, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (bands->fd < 0) {
+        fprintf(stderr, "ERROR: cannot write into file %s: %s\n", bandsPath, strerror(errno));
+        exit(1);
+    }
+    unlink(bandsPath);
+
+    Vec2 *chunk = malloc(OUT_OF_CORE_CHUNK_SEEDS * sizeof(Vec2));
+    uint64_t *written = calloc(bands->bandsCount, sizeof(uint64_t));
+    uint32_t *bucketCounts = calloc(bands->bandsCount, sizeof(uint32_t));
+    SeedRecord *buckets = malloc(bands->bandsCount * OUT_OF_CORE_BUCKET_SEEDS * sizeof(SeedRecord));
+    assert(bands->bandStart != NULL && chunk != NULL && written != NULL && bucketCounts != NULL && buckets != NULL);
+
+    size_t count;
+    uint64_t index = 0;
+    while ((count = fread(chunk, sizeof(Vec2), OUT_OF_CORE_CHUNK_SEEDS, input)) > 0) {
+        for (size_t i = 0; i < count; ++i, ++index) {
+            if (chunk[i].x < 0 || chunk[i].x >= WIDTH || chunk[i].y < 0 || chunk[i].y >= HEIGHT) {
+                fprintf(stderr, "ERROR: seed %llu in %s lies outside the %dx%d image\n",
+                        (unsigned long long)index, seedsPath, WIDTH, HEIGHT);
+                exit(1);
+            }
+            ++bands->bandStart[SeedBandOf(chunk[i].y) + 1];
+        }
+    }
+    assert(!ferror(input));
+    for (size_t band = 0; band < bands->bandsCount; ++band) {
+        bands->bandStart[band + 1] += bands->bandStart[band];
+    }
+    if (bands->bandStart[bands->bandsCount] == 0) {
+        fprintf(stderr, "ERROR: file %s holds no seeds\n", seedsPath);
+        exit(1);
+    }
+
+    rewind(input);
+    index = 0;
+    while ((count = fread(chunk, sizeof(Vec2), OUT_OF_CORE_CHUNK_SEEDS, input)) > 0) {
+        for (size_t i = 0; i < count; ++i, ++index) {
+            size_t band = SeedBandOf(chunk[i].y);
+            SeedRecord *bucket = &buckets[band * OUT_OF_CORE_BUCKET_SEEDS];
+
+            bucket[bucketCounts[band]++] = (SeedRecord){chunk[i].x, chunk[i].y, index};
+            if (bucketCounts[band] == OUT_OF_CORE_BUCKET_SEEDS) {
+                PwriteAll(bands->fd, bucket, OUT_OF_CORE_BUCKET_SEEDS * sizeof(SeedRecord),
+                          (bands->bandStart[band] + written[band]) * sizeof(SeedRecord));
+                written[band] += OUT_OF_CORE_BUCKET_SEEDS;
+                bucketCounts[band] = 0;
+            }
+        }
+    }
+    assert(!ferror(input));
+    for (size_t band = 0; band < bands->bandsCount; ++band) {
+        PwriteAll(bands->fd, &buckets[band * OUT_OF_CORE_BUCKET_SEEDS], bucketCounts[band] * sizeof(SeedRecord),
+                  (bands->bandStart[band] + written[band]) * sizeof(SeedRecord));
+    }
+
+    fclose(input);
+    free(chunk);
+    free(written);
+    free(bucketCounts);
+    free(buckets);
+}
+
+/**
+ * @brief Read the seeds of one band from the band file
+ * 
+ * @param bands 
+ * @param band 
+ * @return SeedRecord* 
+ */
+SeedRecord *LoadSeedBand(const SeedBands *bands, size_t band) 
+{
+    size_t count = bands->bandStart[band + 1] - bands->bandStart[band];
+    SeedRecord *records = malloc((count > 0 ? count : 1) * sizeof(SeedRecord));
+
+    assert(records != NULL);
+    PreadAll(bands->fd, records, count * sizeof(SeedRecord), bands->bandStart[band] * sizeof(SeedRecord));
+    return records;
+}
+
+/**
+ * @brief Body of a prefetch thread
+ * 
+ * @param arg 
+ * @return void* 
+ */
+void *PrefetchSeedBand(void *arg) 
+{
+    BandPrefetch *prefetch = arg;
+    prefetch->records = LoadSeedBand(prefetch->bands, prefetch->band);
+    return NULL;
+}
+
+/**
+ * @brief Get the seeds of a band, from the prefetch thread if it was loading
+ * that band, or read now otherwise
+ * 
+ * @param bands 
+ * @param band 
+ * @param prefetch 
+ * @return SeedRecord* 
+ */
+SeedRecord *TakeSeedBand(const SeedBands *bands, size_t band, BandPrefetch *prefetch) 
+{
+    if (prefetch->active && prefetch->band == band) {
+        pthread_join(prefetch->thread, NULL);
+        prefetch->active = 0;
+        return prefetch->records;
+    }
+    return LoadSeedBand(bands, band);
+}
+
+/**
+ * @brief Start reading a band in the background while the current one renders
+ * 
+ * @param bands 
+ * @param band 
+ * @param prefetch 
+ * @return * Start 
+ */
+void StartSeedBandPrefetch(const SeedBands *bands, size_t band, BandPrefetch *prefetch) 
+{
+    if (prefetch->active) {
+        return;
+    }
+
+    prefetch->bands = bands;
+    prefetch->band = band;
+    prefetch->active = pthread_create(&prefetch->thread, NULL, PrefetchSeedBand, prefetch) == 0;
+}
+
+/**
+ * @brief Check that every tile of a band gathers its candidates inside the
+ * rows whose seeds are loaded: the candidate radius of a tile covers the true
+ * closest seed of all its pixels, so when it stays within the loaded rows no
+ * seed left on disk can win a pixel
+ * 
+ * @param grid 
+ * @param beginY 
+ * @param endY 
+ * @param loadedBeginY First loaded row, or -INFINITY when nothing lies above
+ * @param loadedEndY End of the loaded rows, or INFINITY when nothing lies below
+ * @return int 
+ */
+int GridCoversBand(const SeedGrid *grid, int beginY, int endY, double loadedBeginY, double loadedEndY) 
+{
+    int tileSize = TileSizeForGrid(grid);
+
+    for (int tileY = beginY; tileY < endY; tileY += tileSize) {
+        for (int tileX = 0; tileX < WIDTH; tileX += tileSize) {
+            int tileWidth = tileX + tileSize < WIDTH ? tileSize : WIDTH - tileX;
+            int tileHeight = tileY + tileSize < HEIGHT ? tileSize : HEIGHT - tileY;
+            double centreX = tileX + (tileWidth - 1) * 0.5;
+            double centreY = tileY + (tileHeight - 1) * 0.5;
+            double halfDiagonal = sqrt((tileWidth - 1) * (tileWidth - 1) + (tileHeight - 1) * (tileHeight - 1)) * 0.5;
+            Vec2 closest = grid->points[NearestSeed(grid, centreX, centreY)];
+            double radius = hypot(closest.x - centreX, closest.y - centreY) + 2 * halfDiagonal + 1e-6;
+
+            if (centreY - radius < loadedBeginY || centreY + radius >= loadedEndY) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief Render a seed file too large for memory. The seeds are sorted into
+ * bands of rows on disk, then the image is swept band by band keeping only the
+ * seeds of the current band and its neighbours: the neighbourhood starts one
+ * band away and grows until GridCoversBand proves it exact. The loaded bands
+ * are merged back into input order, so ties resolve as in memory. The band
+ * after the neighbourhood is read by a prefetch thread while the current one
+ * renders, and every band of pixels is written as soon as it is done.
+ * 
+ * @param seedsPath 
+ * @param filePath 
+ * @return * Render 
+ */
+void RenderVoronoiOutOfCore(const char *seedsPath, const char *filePath) 
+{
+    char bandsPath[4096];
+    SeedBands bands;
+    BandPrefetch prefetch = {0};
+
+    snprintf(bandsPath, sizeof(bandsPath), "%s.bands", filePath);
+    ProgressStage(STAGE_INDEX);
+    SortSeedsIntoBands(seedsPath, bandsPath, &bands);
+
+    SeedRecord **loaded = calloc(bands.bandsCount, sizeof(SeedRecord *));
+    size_t *heads = malloc(bands.bandsCount * sizeof(size_t));
+    uint32_t *bandLabels = malloc((size_t)OUT_OF_CORE_BAND_HEIGHT * WIDTH * sizeof(uint32_t));
+    uint8_t *bandBytes = malloc((size_t)OUT_OF_CORE_BAND_HEIGHT * WIDTH * 3);
+    assert(loaded != NULL && heads != NULL && bandLabels != NULL && bandBytes != NULL);
+
+    FILE *file = fopen(filePath, "wb");
+
+    if (file == NULL) {
+        fprintf(stderr, "ERROR: cannot write into file %s: %s\n", filePath, strerror(errno));
+        exit(1);
+    }
+    setvbuf(file, NULL, _IONBF, 0);
+    fprintf(file, "P6\n%d %d 255\n", WIDTH, HEIGHT);
+
+    size_t reach = 1;
+    size_t largestWindow = 0;
+    for (size_t band = 0; band < bands.bandsCount; ++band) {
+        int beginY = band * OUT_OF_CORE_BAND_HEIGHT;
+        int endY = beginY + OUT_OF_CORE_BAND_HEIGHT < HEIGHT ? beginY + OUT_OF_CORE_BAND_HEIGHT : HEIGHT;
+        SeedGrid grid;
+        Vec2 *window = NULL;
+        size_t windowCount, lowBand, highBand;
+
+        ProgressStage(STAGE_INDEX);
+        reach = reach > 1 ? reach - 1 : 1;
+        for (;; ++reach) {
+            lowBand = band > reach ? band - reach : 0;
+            highBand = band + reach < bands.bandsCount ? band + reach : bands.bandsCount - 1;
+
+            for (size_t other = lowBand; other <= highBand; ++other) {
+                if (loaded[other] == NULL) {
+                    loaded[other] = TakeSeedBand(&bands, other, &prefetch);
+                }
+            }
+
+            windowCount = bands.bandStart[highBand + 1] - bands.bandStart[lowBand];
+            if (windowCount == 0) {
+                assert(lowBand > 0 || highBand + 1 < bands.bandsCount);
+                continue;
+            }
+
+            free(window);
+            window = malloc(windowCount * sizeof(Vec2));
+            assert(window != NULL);
+            for (size_t other = lowBand; other <= highBand; ++other) {
+                heads[other] = bands.bandStart[other];
+            }
+            for (size_t i = 0; i < windowCount; ++i) {
+                size_t next = SIZE_MAX;
+                for (size_t other = lowBand; other <= highBand; ++other) {
+                    if (heads[other] < bands.bandStart[other + 1]
+                        && (next == SIZE_MAX || loaded[other][heads[other] - bands.bandStart[other]].index
+                                                < loaded[next][heads[next] - bands.bandStart[next]].index)) {
+                        next = other;
+                    }
+                }
+                SeedRecord record = loaded[next][heads[next]++ - bands.bandStart[next]];
+                window[i] = (Vec2){record.x, record.y};
+            }
+
+            BuildSeedGridSubset(&grid, window, NULL, windowCount, SEED_GRID_DENSITY, NULL);
+            double loadedBeginY = lowBand == 0 ? -INFINITY : (double)lowBand * OUT_OF_CORE_BAND_HEIGHT;
+            double loadedEndY = highBand + 1 == bands.bandsCount ? INFINITY : (double)(highBand + 1) * OUT_OF_CORE_BAND_HEIGHT;
+            if (GridCoversBand(&grid, beginY, endY, loadedBeginY, loadedEndY)) {
+                break;
+            }
+            FreeSeedGrid(&grid);
+        }
+        largestWindow = windowCount > largestWindow ? windowCount : largestWindow;
+
+        for (size_t other = 0; other < lowBand; ++other) {
+            free(loaded[other]);
+            loaded[other] = NULL;
+        }
+        if (highBand + 1 < bands.bandsCount && loaded[highBand + 1] == NULL) {
+            StartSeedBandPrefetch(&bands, highBand + 1, &prefetch);
+        }
+
+        ProgressStage(STAGE_RENDER);
+        RenderBandWithGrid(&grid, NULL, beginY, endY, bandLabels);
+
+        ProgressStage(STAGE_ENCODE);
+        for (size_t i = 0; i < windowCount; ++i) {
+            Vec2 origin = window[i];
+
+            if (origin.y + SEED_MARKER_RADIUS <= beginY || origin.y - SEED_MARKER_RADIUS >= endY) {
+                continue;
+            }
+            for (int y = origin.y - SEED_MARKER_RADIUS; y < origin.y + SEED_MARKER_RADIUS; ++y) {
+                for (int x = origin.x - SEED_MARKER_RADIUS; x < origin.x + SEED_MARKER_RADIUS; ++x) {
+                    Vec2 point = {x, y};
+
+                    if (beginY <= y && y < endY && 0 <= x && x < WIDTH
+                        && SquareDistance(origin, point) <= SEED_MARKER_RADIUS * SEED_MARKER_RADIUS) {
+                        bandLabels[(size_t)(y - beginY) * WIDTH + x] = LABEL_NONE;
+                    }
+                }
+            }
+        }
+        EncodeLabelsPPM(bandLabels, window, endY - beginY, bandBytes);
+
+        ProgressStage(STAGE_WRITE);
+        fwrite(bandBytes, (size_t)(endY - beginY) * WIDTH * 3, 1, file);
+        assert(!ferror(file));
+        ProgressBytes((uint64_t)(endY - beginY) * WIDTH * 3);
+
+        FreeSeedGrid(&grid);
+        free(window);
+    }
+
+    if (prefetch.active) {
+        pthread_join(prefetch.thread, NULL);
+        free(prefetch.records);
+    }
+    for (size_t band = 0; band < bands.bandsCount; ++band) {
+        free(loaded[band]);
+    }
+    fprintf(stderr, "out of core: %llu seeds in %zu bands, at most %zu seeds in memory\n",
+            (unsigned long long)bands.bandStart[bands.bandsCount], bands.bandsCount, largestWindow);
+
+    int err = fclose(file);
+    assert(err == 0);
+    close(bands.fd);
+    free(bands.bandStart);
+    free(loaded);
+    free(heads);
+    free(bandLabels);
+    free(bandBytes);
+}
+
+/**
+ * @brief Check that every in-domain pixel is closer to some indexed seed than
+ * the margin around the domain's bounding box, beyond which seeds were left
+ * out of the grid
+ * 
+ * @param grid 
+ * @param mask 
+ * @param margin 
+ * @return int 
+ */
+int GridCoversMask(const SeedGrid *grid, const DomainMask *mask, double margin) 
+{
+    int tileSize = TileSizeForGrid(grid);
+
+    for (int tileY = 0; tileY < HEIGHT; tileY += tileSize) {
+        for (int tileX = 0; tileX < WIDTH; tileX += tileSize) {
+            int endX = tileX + tileSize < WIDTH ? tileX + tileSize : WIDTH;
+            int endY = tileY + tileSize < HEIGHT ? tileY + tileSize : HEIGHT;
+
+            if (!MaskTouchesRect(mask, tileX, tileY, endX, endY)) {
+                continue;
+            }
+
+            double centreX = (tileX + endX - 1) * 0.5;
+            double centreY = (tileY + endY - 1) * 0.5;
+            double halfDiagonal = sqrt((endX - tileX - 1) * (endX - tileX - 1) + (endY - tileY - 1) * (endY - tileY - 1)) * 0.5;
+            Vec2 closest = grid->points[NearestSeed(grid, centreX, centreY)];
+
+            if (hypot(closest.x - centreX, closest.y - centreY) + halfDiagonal >= margin) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief Render only the pixels inside a domain mask. Only the seeds around
+ * the domain are indexed: the margin around its bounding box grows until the
+ * indexed seeds provably own every in-domain pixel.
+ * 
+ * @param mask 
+ * @return * Render 
+ */
+void RenderVoronoiMasked(const DomainMask *mask) 
+{
+    int minX = WIDTH, minY = HEIGHT, maxX = -1, maxY = -1;
+
+    memset(labels, 0xFF, sizeof(labels));
+    for (int y = 0; y < HEIGHT; ++y) {
+        for (uint32_t i = mask->rowStart[y]; i < mask->rowStart[y + 1]; ++i) {
+            minX = mask->spans[i].begin < minX ? mask->spans[i].begin : minX;
+            maxX = mask->spans[i].end - 1 > maxX ? mask->spans[i].end - 1 : maxX;
+            minY = y < minY ? y : minY;
+            maxY = y;
+        }
+    }
+    if (maxX < 0) {
+        return;
+    }
+
+    Arena *arena = ThreadArena();
+    size_t mark = arena->used;
+    uint32_t *seedIdxs = ArenaAlloc(arena, SEEDS_COUNT * sizeof(uint32_t));
+    size_t gridMark = arena->used;
+    SeedGrid grid;
+
+    for (double margin = TILE_SIZE; ; margin *= 2) {
+        size_t count = 0;
+
+        for (size_t i = 0; i < SEEDS_COUNT; ++i) {
+            if (minX - margin < seeds[i].x && seeds[i].x < maxX + margin
+                && minY - margin < seeds[i].y && seeds[i].y < maxY + margin) {
+                seedIdxs[count++] = i;
+            }
+        }
+        if (count == 0) {
+            continue;
+        }
+
+        ArenaRewind(arena, gridMark);
+        BuildSeedGridSubset(&grid, seeds, seedIdxs, count, SEED_GRID_DENSITY, arena);
+        if (count == SEEDS_COUNT || GridCoversMask(&grid, mask, margin)) {
+            break;
+        }
+    }
+
+    RenderVoronoiWithGrid(&grid, mask);
+    ArenaRewind(arena, mark);
+}
+
+/**
+ * @brief Get how much of a pixel an edge line covers. The distance to the
+ * edge is measured along the bisector of the closest and second closest
+ * seeds, and the line is anti-aliased over one pixel.
+ * 
+ * @param closest 
+ * @param second 
+ * @param x 
+ * @param y 
+ * @param edgeWidth 
+ * @return double 
+ */
+double EdgeCoverage(Vec2 closest, Vec2 second, int x, int y, double edgeWidth) 
+{
+    Vec2 pixel = {x, y};
+    double gap = SquareDistance(second, pixel) - SquareDistance(closest, pixel);
+    double spacing = SquareDistance(closest, second);
+
+    if (gap * gap >= (edgeWidth + 1) * (edgeWidth + 1) * spacing) {
+        return 0;
+    }
+
+    double distance = gap / (2 * sqrt(spacing));
+    double coverage = edgeWidth * 0.5 + 0.5 - distance;
+
+    return coverage < 0 ? 0 : coverage > 1 ? 1 : coverage;
+}
+
+/**
+ * @brief Render only the cell edges into the image, lines of the given width
+ * over the background. Every tile tracks the closest and second closest seed
+ * of its pixels in the same scan over its candidates, and the label buffer
+ * still gets the closest seeds.
+ * 
+ * @param edgeWidth 
+ * @return * Render 
+ */
+void RenderVoronoiEdges(double edgeWidth) 
+{
+    Arena *arena = ThreadArena();
+    size_t mark = arena->used;
+    SeedGrid grid;
+
+    BuildSeedGrid(&grid, seeds, SEEDS_COUNT, arena);
+
+    int tileSize = TileSizeForGrid(&grid);
+    int tilesX = (WIDTH + tileSize - 1) / tileSize;
+    int tilesY = (HEIGHT + tileSize - 1) / tileSize;
+
+    #pragma omp parallel for schedule(dynamic)
+    for (int tile = 0; tile < tilesX * tilesY; ++tile) {
+        TileBuffer *buffer = PoolAlloc(ThreadTilePool(), sizeof(TileBuffer));
+        uint32_t *seedIdxs = buffer->seedIdxs;
+        int *candidatesX = buffer->candidatesX;
+        int *candidatesY = buffer->candidatesY;
+        int tileX = tile % tilesX * tileSize;
+        int tileY = tile / tilesX * tileSize;
+        int endX = tileX + tileSize < WIDTH ? tileX + tileSize : WIDTH;
+        int endY = tileY + tileSize < HEIGHT ? tileY + tileSize : HEIGHT;
+        size_t count = GatherTileEdgeCandidates(&grid, tileX, tileY, tileSize, seedIdxs);
+
+        for (size_t i = 0; i < count; ++i) {
+            candidatesX[i] = seeds[seedIdxs[i]].x;
+            candidatesY[i] = seeds[seedIdxs[i]].y;
+        }
+
+        for (int y = tileY; y < endY; ++y) {
+            for (int x = tileX; x < endX; ++x) {
+                uint32_t nearest[2];
+
+                if (count == 0) {
+                    NearestTwoSeeds(&grid, x, y, nearest);
+                } else {
+                    size_t closestIdx = 0, secondIdx = count;
+                    int closestDist = INT32_MAX, secondDist = INT32_MAX;
+
+                    for (size_t i = 0; i < count; ++i) {
+                        int dx = candidatesX[i] - x;
+                        int dy = candidatesY[i] - y;
+                        int currDist = dx * dx + dy * dy;
+
+                        if (currDist < closestDist) {
+                            secondDist = closestDist;
+                            secondIdx = closestIdx;
+                            closestDist = currDist;
+                            closestIdx = i;
+                        } else if (currDist < secondDist
+                                   && (candidatesX[i] != candidatesX[closestIdx] || candidatesY[i] != candidatesY[closestIdx])) {
+                            secondDist = currDist;
+                            secondIdx = i;
+                        }
+                    }
+
+                    nearest[0] = seedIdxs[closestIdx];
+                    nearest[1] = secondIdx < count ? seedIdxs[secondIdx] : LABEL_NONE;
+                }
+
+                double coverage = nearest[1] == LABEL_NONE ? 0
+                    : EdgeCoverage(seeds[nearest[0]], seeds[nearest[1]], x, y, edgeWidth);
+
+                labels[y][x] = nearest[0];
+                image[y][x] = coverage > 0 ? BlendColors(COLOR_BACKGROUND, EDGE_COLOR, coverage) : COLOR_BACKGROUND;
+            }
+        }
+
+        PoolFree(ThreadTilePool(), buffer);
+    }
+
+    ArenaRewind(arena, mark);
+}
+
+/**
+ * @brief Blend a layer color over the color below it
+ * 
+ * @param below 
+ * @param above 
+ * @param mode 
+ * @param opacity 
+ * @return Color 
+ */
+Color BlendLayerColor(Color below, Color above, BlendMode mode, double opacity) 
+{
+    Color mixed = below & 0xFF000000;
+
+    for (int shift = 0; shift < 24; shift += 8) {
+        int a = (below >> shift) & 0xFF;
+        int b = (above >> shift) & 0xFF;
+        int channel = b;
+
+        switch (mode) {
+        case BLEND_NORMAL:     channel = b; break;
+        case BLEND_MULTIPLY:   channel = a * b / 255; break;
+        case BLEND_SCREEN:     channel = 255 - (255 - a) * (255 - b) / 255; break;
+        case BLEND_ADD:        channel = a + b < 255 ? a + b : 255; break;
+        case BLEND_DIFFERENCE: channel = a > b ? a - b : b - a; break;
+        }
+        mixed |= (Color)channel << shift;
+    }
+    return BlendColors(below, mixed, opacity);
+}
+
+/**
+ * @brief Collect the seeds whose cells can reach into a tile under a metric.
+ * The closest seed by euclidean distance bounds the metric distance of the
+ * winner of every pixel, and a manhattan ball fits in the euclidean ball of
+ * the same radius, so gathering by euclidean radius stays conservative.
+ * Returns 0 if the list does not fit.
+ * 
+ * @param grid 
+ * @param metric 
+ * @param tileX 
+ * @param tileY 
+ * @param tileSize 
+ * @param seedIdxs 
+ * @return size_t 
+ */
+size_t GatherLayerCandidates(const SeedGrid *grid, Metric metric, int tileX, int tileY, int tileSize, uint32_t *seedIdxs) 
+{
+    if (metric == METRIC_EUCLIDEAN) {
+        return GatherTileCandidates(grid, tileX, tileY, tileSize, seedIdxs);
+    }
+
+    int tileWidth = tileX + tileSize < WIDTH ? tileSize : WIDTH - tileX;
+    int tileHeight = tileY + tileSize < HEIGHT ? tileSize : HEIGHT - tileY;
+    double centreX = tileX + (tileWidth - 1) * 0.5;
+    double centreY = tileY + (tileHeight - 1) * 0.5;
+    double halfExtent = (tileWidth - 1 + tileHeight - 1) * 0.5;
+
+    Vec2 closest = grid->points[NearestSeed(grid, centreX, centreY)];
+    double radius = fabs(closest.x - centreX) + fabs(closest.y - centreY) + 2 * halfExtent + 1e-6;
+
+    size_t count = GatherSeeds(grid, centreX, centreY, radius, seedIdxs, TILE_MAX_CANDIDATES);
+    if (count > TILE_MAX_CANDIDATES) {
+        return 0;
+    }
+
+    qsort(seedIdxs, count, sizeof(uint32_t), CompareSeedIdxs);
+    return count;
+}
+
+/**
+ * @brief Find the closest seed to a pixel under a metric by scanning every
+ * seed, for tiles whose candidate list overflowed
+ * 
+ * @param grid 
+ * @param metric 
+ * @param x 
+ * @param y 
+ * @return uint32_t 
+ */
+uint32_t NearestLayerSeed(const SeedGrid *grid, Metric metric, int x, int y) 
+{
+    if (metric == METRIC_EUCLIDEAN) {
+        return NearestSeed(grid, x, y);
+    }
+
+    Vec2 pixel = {x, y};
+    uint32_t closestSeedIdx = 0;
+    int closestDist = INT32_MAX;
+
+    for (size_t i = 0; i < grid->count; ++i) {
+        int currDist = ManhattanDistance(grid->points[i], pixel);
+
+        if (currDist < closestDist) {
+            closestDist = currDist;
+            closestSeedIdx = i;
+        }
+    }
+    return closestSeedIdx;
+}
+
+/**
+ * @brief Render the composite of every layer of the layer table, each with its
+ * own random seeds, grid, metric and blend mode. Every tile gathers the
+ * candidates of all layers once, then each pixel resolves its closest seed in
+ * every layer and blends the layers bottom to top before a single write to
+ * the image.
+ * 
+ * @return * Render 
+ */
+void RenderLayers() 
+{
+    Arena *arena = ThreadArena();
+    size_t mark = arena->used;
+    SeedGrid grids[LAYERS_COUNT];
+    int tileSize = TILE_SIZE;
+
+    for (size_t l = 0; l < LAYERS_COUNT; ++l) {
+        Vec2 *points = ArenaAlloc(arena, layers[l].seedsCount * sizeof(Vec2));
+
+        for (size_t i = 0; i < layers[l].seedsCount; ++i) {
+            points[i].x = rand() % WIDTH;
+            points[i].y = rand() % HEIGHT;
+        }
+        BuildSeedGrid(&grids[l], points, layers[l].seedsCount, arena);
+
+        int layerTileSize = TileSizeForGrid(&grids[l]);
+        tileSize = layerTileSize < tileSize ? layerTileSize : tileSize;
+    }
+
+    int tilesX = (WIDTH + tileSize - 1) / tileSize;
+    int tilesY = (HEIGHT + tileSize - 1) / tileSize;
+
+    #pragma omp parallel for schedule(dynamic)
+    for (int tile = 0; tile < tilesX * tilesY; ++tile) {
+        TileBuffer *buffers[LAYERS_COUNT];
+        size_t counts[LAYERS_COUNT];
+        int tileX = tile % tilesX * tileSize;
+        int tileY = tile / tilesX * tileSize;
+        int endX = tileX + tileSize < WIDTH ? tileX + tileSize : WIDTH;
+        int endY = tileY + tileSize < HEIGHT ? tileY + tileSize : HEIGHT;
+
+        for (size_t l = 0; l < LAYERS_COUNT; ++l) {
+            buffers[l] = PoolAlloc(ThreadTilePool(), sizeof(TileBuffer));
+            counts[l] = GatherLayerCandidates(&grids[l], layers[l].metric, tileX, tileY, tileSize, buffers[l]->seedIdxs);
+
+            for (size_t i = 0; i < counts[l]; ++i) {
+                buffers[l]->candidatesX[i] = grids[l].points[buffers[l]->seedIdxs[i]].x;
+                buffers[l]->candidatesY[i] = grids[l].points[buffers[l]->seedIdxs[i]].y;
+            }
+        }
+
+        for (int y = tileY; y < endY; ++y) {
+            for (int x = tileX; x < endX; ++x) {
+                Color pixel = COLOR_BACKGROUND;
+
+                for (size_t l = 0; l < LAYERS_COUNT; ++l) {
+                    const TileBuffer *buffer = buffers[l];
+                    uint32_t seedIdx;
+
+                    if (counts[l] == 0) {
+                        seedIdx = NearestLayerSeed(&grids[l], layers[l].metric, x, y);
+                    } else {
+                        size_t closestIdx = 0;
+                        int closestDist = INT32_MAX;
+
+                        for (size_t i = 0; i < counts[l]; ++i) {
+                            int dx = buffer->candidatesX[i] - x;
+                            int dy = buffer->candidatesY[i] - y;
+                            int currDist = layers[l].metric == METRIC_MANHATTAN
+                                ? abs(dx) + abs(dy) : dx * dx + dy * dy;
+
+                            if (currDist < closestDist) {
+                                closestDist = currDist;
+                                closestIdx = i;
+                            }
+                        }
+                        seedIdx = buffer->seedIdxs[closestIdx];
+                    }
+
+                    pixel = BlendLayerColor(pixel, SeedToColor(grids[l].points[seedIdx]), layers[l].blend, layers[l].opacity);
+                }
+
+                image[y][x] = pixel;
+            }
+        }
+
+        for (size_t l = 0; l < LAYERS_COUNT; ++l) {
+            PoolFree(ThreadTilePool(), buffers[l]);
+        }
+    }
+
+    ArenaRewind(arena, mark);
+}
+
+/**
+ * @brief Render cells within cells: the seeds are the coarse level, and every
+ * coarse cell is split by the fine seeds falling into it, a coarse seed
+ * standing in for its cell's fine seeds when none fell there. Each coarse
+ * cell indexes its fine seeds in its own compact grid. Every tile gathers
+ * the coarse candidates, and the fine candidates of a parent the first time
+ * one of its pixels is resolved to it, so each pixel is resolved at both
+ * levels in a single traversal. The label buffer holds the fine labels.
+ * 
+ * @param fineCount 
+ * @return * Render 
+ */
+void RenderNested(size_t fineCount) 
+{
+    Arena *arena = ThreadArena();
+    size_t mark = arena->used;
+    SeedGrid coarseGrid;
+
+    ProgressStage(STAGE_INDEX);
+    BuildSeedGrid(&coarseGrid, seeds, SEEDS_COUNT, arena);
+
+    Vec2 *finePoints = ArenaAlloc(arena, (fineCount + SEEDS_COUNT) * sizeof(Vec2));
+    uint32_t *parents = ArenaAlloc(arena, (fineCount + SEEDS_COUNT) * sizeof(uint32_t));
+    uint32_t *parentStart = ArenaAlloc(arena, (SEEDS_COUNT + 1) * sizeof(uint32_t));
+    uint32_t *parentSeeds = ArenaAlloc(arena, (fineCount + SEEDS_COUNT) * sizeof(uint32_t));
+    SeedGrid *fineGrids = ArenaAlloc(arena, SEEDS_COUNT * sizeof(SeedGrid));
+
+    memset(parentStart, 0, (SEEDS_COUNT + 1) * sizeof(uint32_t));
+    for (size_t i = 0; i < fineCount; ++i) {
+        finePoints[i].x = rand() % WIDTH;
+        finePoints[i].y = rand() % HEIGHT;
+        parents[i] = NearestSeed(&coarseGrid, finePoints[i].x, finePoints[i].y);
+        ++parentStart[parents[i] + 1];
+    }
+    for (size_t p = 0; p < SEEDS_COUNT; ++p) {
+        if (parentStart[p + 1] == 0) {
+            finePoints[fineCount] = seeds[p];
+            parents[fineCount++] = p;
+            ++parentStart[p + 1];
+        }
+    }
+    for (size_t p = 0; p < SEEDS_COUNT; ++p) {
+        parentStart[p + 1] += parentStart[p];
+    }
+    for (size_t i = 0; i < fineCount; ++i) {
+        parentSeeds[parentStart[parents[i]]++] = i;
+    }
+    for (size_t p = SEEDS_COUNT; p > 0; --p) {
+        parentStart[p] = parentStart[p - 1];
+    }
+    parentStart[0] = 0;
+
+    int tileSize = TileSizeForGrid(&coarseGrid);
+    for (size_t p = 0; p < SEEDS_COUNT; ++p) {
+        BuildSeedGridSubset(&fineGrids[p], finePoints, &parentSeeds[parentStart[p]], parentStart[p + 1] - parentStart[p], SEED_GRID_DENSITY, arena);
+
+        int fineTileSize = TileSizeForGrid(&fineGrids[p]);
+        tileSize = fineTileSize < tileSize ? fineTileSize : tileSize;
+    }
+
+    ProgressStage(STAGE_RENDER);
+    int tilesX = (WIDTH + tileSize - 1) / tileSize;
+    int tilesY = (HEIGHT + tileSize - 1) / tileSize;
+
+    #pragma omp parallel for schedule(dynamic)
+    for (int tile = 0; tile < tilesX * tilesY; ++tile) {
+        TileBuffer *coarse = PoolAlloc(ThreadTilePool(), sizeof(TileBuffer));
+        TileBuffer *fines[NESTED_TILE_PARENTS];
+        uint32_t fineParents[NESTED_TILE_PARENTS];
+        size_t fineCounts[NESTED_TILE_PARENTS];
+        size_t finesCount = 0;
+        int tileX = tile % tilesX * tileSize;
+        int tileY = tile / tilesX * tileSize;
+        int endX = tileX + tileSize < WIDTH ? tileX + tileSize : WIDTH;
+        int endY = tileY + tileSize < HEIGHT ? tileY + tileSize : HEIGHT;
+        size_t count = GatherTileCandidates(&coarseGrid, tileX, tileY, tileSize, coarse->seedIdxs);
+
+        for (size_t i = 0; i < count; ++i) {
+            coarse->candidatesX[i] = seeds[coarse->seedIdxs[i]].x;
+            coarse->candidatesY[i] = seeds[coarse->seedIdxs[i]].y;
+        }
+
+        for (int y = tileY; y < endY; ++y) {
+            for (int x = tileX; x < endX; ++x) {
+                uint32_t parent;
+
+                if (count == 0) {
+                    parent = NearestSeed(&coarseGrid, x, y);
+                } else {
+                    size_t closestIdx = 0;
+                    int closestDist = INT32_MAX;
+
+                    for (size_t i = 0; i < count; ++i) {
+                        int dx = coarse->candidatesX[i] - x;
+                        int dy = coarse->candidatesY[i] - y;
+                        int currDist = dx * dx + dy * dy;
+
+                        if (currDist < closestDist) {
+                            closestDist = currDist;
+                            closestIdx = i;
+                        }
+                    }
+                    parent = coarse->seedIdxs[closestIdx];
+                }
+
+                size_t slot = 0;
+                while (slot < finesCount && fineParents[slot] != parent) {
+                    ++slot;
+                }
+                if (slot == finesCount && finesCount < NESTED_TILE_PARENTS) {
+                    TileBuffer *fine = PoolAlloc(ThreadTilePool(), sizeof(TileBuffer));
+
+                    fineCounts[slot] = GatherTileCandidates(&fineGrids[parent], tileX, tileY, tileSize, fine->seedIdxs);
+                    for (size_t i = 0; i < fineCounts[slot]; ++i) {
+                        fine->candidatesX[i] = finePoints[fine->seedIdxs[i]].x;
+                        fine->candidatesY[i] = finePoints[fine->seedIdxs[i]].y;
+                    }
+                    fines[slot] = fine;
+                    fineParents[slot] = parent;
+                    ++finesCount;
+                }
+
+                uint32_t label;
+                if (slot == finesCount || fineCounts[slot] == 0) {
+                    label = NearestSeed(&fineGrids[parent], x, y);
+                } else {
+                    const TileBuffer *fine = fines[slot];
+                    size_t closestIdx = 0;
+                    int closestDist = INT32_MAX;
+
+                    for (size_t i = 0; i < fineCounts[slot]; ++i) {
+                        int dx = fine->candidatesX[i] - x;
+                        int dy = fine->candidatesY[i] - y;
+                        int currDist = dx * dx + dy * dy;
+
+                        if (currDist < closestDist) {
+                            closestDist = currDist;
+                            closestIdx = i;
+                        }
+                    }
+                    label = fine->seedIdxs[closestIdx];
+                }
+
+                labels[y][x] = label;
+                image[y][x] = BlendColors(SeedToColor(seeds[parent]), SeedToColor(finePoints[label]), NESTED_FINE_BLEND);
+            }
+        }
+
+        for (size_t slot = 0; slot < finesCount; ++slot) {
+            PoolFree(ThreadTilePool(), fines[slot]);
+        }
+        PoolFree(ThreadTilePool(), coarse);
+    }
+
+    ArenaRewind(arena, mark);
+}
+
+/**
+ * @brief Render the label buffer for seeds under any metric. Tiles gather their
+ * candidates as the layers do, so Manhattan cells get the same culling as
+ * euclidean ones.
+ * 
+ * @param grid 
+ * @param metric 
+ * @return * Render 
+ */
+void RenderVoronoiMetricWithGrid(const SeedGrid *grid, Metric metric) 
+{
+    if (metric == METRIC_EUCLIDEAN) {
+        RenderVoronoiWithGrid(grid, NULL);
+        return;
+    }
+
+    int tileSize = TileSizeForGrid(grid);
+    int tilesX = (WIDTH + tileSize - 1) / tileSize;
+    int tilesY = (HEIGHT + tileSize - 1) / tileSize;
+
+    #pragma omp parallel for schedule(dynamic)
+    for (int tile = 0; tile < tilesX * tilesY; ++tile) {
+        TileBuffer *buffer = PoolAlloc(ThreadTilePool(), sizeof(TileBuffer));
+        int tileX = tile % tilesX * tileSize;
+        int tileY = tile / tilesX * tileSize;
+        int endX = tileX + tileSize < WIDTH ? tileX + tileSize : WIDTH;
+        int endY = tileY + tileSize < HEIGHT ? tileY + tileSize : HEIGHT;
+        size_t count = GatherLayerCandidates(grid, metric, tileX, tileY, tileSize, buffer->seedIdxs);
+
+        for (size_t i = 0; i < count; ++i) {
+            buffer->candidatesX[i] = grid->points[buffer->seedIdxs[i]].x;
+            buffer->candidatesY[i] = grid->points[buffer->seedIdxs[i]].y;
+        }
+
+        for (int y = tileY; y < endY; ++y) {
+            for (int x = tileX; x < endX; ++x) {
+                if (count == 0) {
+                    labels[y][x] = NearestLayerSeed(grid, metric, x, y);
+                    continue;
+                }
+
+                size_t closestIdx = 0;
+                int closestDist = INT32_MAX;
+
+                for (size_t i = 0; i < count; ++i) {
+                    int currDist = abs(buffer->candidatesX[i] - x) + abs(buffer->candidatesY[i] - y);
+
+                    if (currDist < closestDist) {
+                        closestDist = currDist;
+                        closestIdx = i;
+                    }
+                }
+                labels[y][x] = buffer->seedIdxs[closestIdx];
+            }
+        }
+
+        PoolFree(ThreadTilePool(), buffer);
+    }
+}
+
+/**
+ * @brief Position of a point along the Hilbert curve filling a square
+ * 
+ * @param side Power of two covering both coordinates
+ * @param x 
+ * @param y 
+ * @return uint64_t 
+ */
+uint64_t HilbertIndex(uint32_t side, uint32_t x, uint32_t y) 
+{
+    uint64_t index = 0;
+
+    for (uint32_t s = side / 2; s > 0; s /= 2) {
+        uint32_t rx = (x & s) > 0;
+        uint32_t ry = (y & s) > 0;
+
+        index += (uint64_t)s * s * ((3 * rx) ^ ry);
+        if (ry == 0) {
+            if (rx == 1) {
+                x = side - 1 - x;
+                y = side - 1 - y;
+            }
+            uint32_t t = x;
+            x = y;
+            y = t;
+        }
+    }
+    return index;
+}
+
+/**
+ * @brief Point at a position along the Hilbert curve, the inverse of
+ * HilbertIndex
+ * 
+ * @param side 
+ * @param index 
+ * @return Vec2 
+ */
+Vec2 HilbertPoint(uint32_t side, uint64_t index) 
+{
+    uint32_t x = 0, y = 0;
+
+    for (uint32_t s = 1; s < side; s *= 2) {
+        uint32_t rx = 1 & (index / 2);
+        uint32_t ry = 1 & (index ^ rx);
+
+        if (ry == 0) {
+            if (rx == 1) {
+                x = s - 1 - x;
+                y = s - 1 - y;
+            }
+            uint32_t t = x;
+            x = y;
+            y = t;
+        }
+        x += s * rx;
+        y += s * ry;
+        index /= 4;
+    }
+    return (Vec2){(int)x, (int)y};
+}
+
+/**
+ * @brief Smallest power of two covering the image, the side of its Hilbert curve
+ * 
+ * @param width 
+ * @param height 
+ * @return uint32_t 
+ */
+uint32_t HilbertSide(uint32_t width, uint32_t height) 
+{
+    uint32_t side = 1;
+
+    while (side < width || side < height) {
+        side *= 2;
+    }
+    return side;
+}
+
+/**
+ * @brief Write an unsigned LEB128 varint
+ * 
+ * @param bytes At least VOR_MAX_VARINT_BYTES long
+ * @param value 
+ * @return size_t Bytes written
+ */
+size_t PutVarint(uint8_t *bytes, uint64_t value) 
+{
+    size_t size = 0;
+
+    while (value >= 0x80) {
+        bytes[size++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    bytes[size++] = (uint8_t)value;
+    return size;
+}
+
+/**
+ * @brief Read an unsigned LEB128 varint and advance the cursor past it
+ * 
+ * @param cursor 
+ * @param end 
+ * @param value 
+ * @return int 0 if the varint runs past the end or overflows
+ */
+int GetVarint(const uint8_t **cursor, const uint8_t *end, uint64_t *value) 
+{
+    *value = 0;
+    for (int shift = 0; shift < 64 && *cursor < end; shift += 7) {
+        uint8_t byte = *(*cursor)++;
+
+        *value |= (uint64_t)(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Order 64-bit keys, such as a Hilbert position above a seed index
+ * 
+ * @param a 
+ * @param b 
+ * @return int 
+ */
+int CompareHilbertKeys(const void *a, const void *b) 
+{
+    uint64_t lf = *(const uint64_t *)a;
+    uint64_t rg = *(const uint64_t *)b;
+
+    return (lf > rg) - (lf < rg);
+}
+
+/**
+ * @brief Sort seeds along the Hilbert curve of the image, keeping the original
+ * order between coincident seeds. The .vor format stores seeds in this order,
+ * so rendering them sorted beforehand breaks distance ties the same way the
+ * decoder will.
+ * 
+ * @param points 
+ * @param count 
+ * @return * Sort 
+ */
+void SortSeedsHilbert(Vec2 *points, size_t count) 
+{
+    uint32_t side = HilbertSide(WIDTH, HEIGHT);
+    uint64_t *keys = malloc(count * sizeof(uint64_t));
+    Vec2 *sorted = malloc(count * sizeof(Vec2));
+    assert(keys != NULL && sorted != NULL);
+    assert(side <= (1 << 16));
+
+    for (size_t i = 0; i < count; ++i) {
+        keys[i] = HilbertIndex(side, points[i].x, points[i].y) << 32 | i;
+    }
+    qsort(keys, count, sizeof(uint64_t), CompareHilbertKeys);
+    for (size_t i = 0; i < count; ++i) {
+        sorted[i] = points[(uint32_t)keys[i]];
+    }
+    memcpy(points, sorted, count * sizeof(Vec2));
+
+    free(sorted);
+    free(keys);
+}
+
+/**
+ * @brief Encode a diagram as a .vor file: the magic, then varints for the
+ * dimensions, metric, marker radius and color, the palette as RGB triplets,
+ * the Hilbert position deltas of the seeds and their palette indices, each
+ * zigzag coded against the index after the previous seed's so a palette in
+ * first-use order costs a byte per seed. Seeds are written in Hilbert order,
+ * see SortSeedsHilbert. Sorting the colors points every seed at the first
+ * seed of its color, and those take palette indices in order.
+ * 
+ * @param filePath 
+ * @param points 
+ * @param colors Color of every seed's cell
+ * @param count 
+ * @param metric 
+ * @param markerRadius 0 for no seed markers
+ * @param markerColor 
+ * @return size_t Bytes written
+ */
+size_t SaveVoronoiImage(const char *filePath, const Vec2 *points, const Color *colors, size_t count, Metric metric, int markerRadius, Color markerColor) 
+{
+    uint32_t side = HilbertSide(WIDTH, HEIGHT);
+    uint64_t *keys = malloc(count * sizeof(uint64_t));
+    uint64_t *colorKeys = malloc(count * sizeof(uint64_t));
+    uint32_t *paletteIdxs = malloc(count * sizeof(uint32_t));
+    Color *palette = malloc(count * sizeof(Color));
+    uint8_t *bytes = malloc(sizeof(VOR_MAGIC) + (8 + 2 * count) * VOR_MAX_VARINT_BYTES + 3 * count);
+    size_t paletteCount = 0;
+    size_t size = 0;
+    assert(keys != NULL && colorKeys != NULL && paletteIdxs != NULL && palette != NULL && bytes != NULL);
+    assert(side <= (1 << 16));
+
+    for (size_t i = 0; i < count; ++i) {
+        assert(0 <= points[i].x && points[i].x < WIDTH);
+        assert(0 <= points[i].y && points[i].y < HEIGHT);
+        keys[i] = HilbertIndex(side, points[i].x, points[i].y) << 32 | i;
+    }
+    qsort(keys, count, sizeof(uint64_t), CompareHilbertKeys);
+
+    for (size_t i = 0; i < count; ++i) {
+        colorKeys[i] = (uint64_t)(colors[(uint32_t)keys[i]] & 0xFFFFFF) << 32 | i;
+    }
+    qsort(colorKeys, count, sizeof(uint64_t), CompareHilbertKeys);
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t order = (uint32_t)colorKeys[i];
+        int sameColor = i > 0 && colorKeys[i] >> 32 == colorKeys[i - 1] >> 32;
+        paletteIdxs[order] = sameColor ? paletteIdxs[(uint32_t)colorKeys[i - 1]] : order;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        if (paletteIdxs[i] == i) {
+            palette[paletteCount] = colors[(uint32_t)keys[i]] & 0xFFFFFF;
+            paletteIdxs[i] = paletteCount++;
+        } else {
+            paletteIdxs[i] = paletteIdxs[paletteIdxs[i]];
+        }
+    }
+
+    memcpy(bytes, VOR_MAGIC, strlen(VOR_MAGIC));
+    size += strlen(VOR_MAGIC);
+    size += PutVarint(&bytes[size], WIDTH);
+    size += PutVarint(&bytes[size], HEIGHT);
+    size += PutVarint(&bytes[size], metric);
+    size += PutVarint(&bytes[size], markerRadius);
+    size += PutVarint(&bytes[size], markerColor & 0xFFFFFF);
+    size += PutVarint(&bytes[size], paletteCount);
+    for (size_t p = 0; p < paletteCount; ++p) {
+        bytes[size++] = (uint8_t)(palette[p] >> 8 * 0);
+        bytes[size++] = (uint8_t)(palette[p] >> 8 * 1);
+        bytes[size++] = (uint8_t)(palette[p] >> 8 * 2);
+    }
+    size += PutVarint(&bytes[size], count);
+
+    uint64_t previous = 0;
+    for (size_t i = 0; i < count; ++i) {
+        uint64_t position = keys[i] >> 32;
+        size += PutVarint(&bytes[size], position - previous);
+        previous = position;
+    }
+
+    int64_t expected = 0;
+    for (size_t i = 0; i < count; ++i) {
+        int64_t delta = (int64_t)paletteIdxs[i] - expected;
+        size += PutVarint(&bytes[size], (uint64_t)delta << 1 ^ (uint64_t)(delta >> 63));
+        expected = (int64_t)paletteIdxs[i] + 1;
+    }
+
+    FILE *file = fopen(filePath, "wb");
+    if (file == NULL) {
+        fprintf(stderr, "ERROR: cannot write into file %s: %s\n", filePath, strerror(errno));
+        exit(1);
+    }
+    fwrite(bytes, size, 1, file);
+    assert(!ferror(file));
+
+    int err = fclose(file);
+    assert(err == 0);
+
+    free(bytes);
+    free(palette);
+    free(paletteIdxs);
+    free(colorKeys);
+    free(keys);
+    return size;
+}
+
+/**
+ * @brief Decode a .vor file into the image: the seeds are rebuilt from their
+ * Hilbert positions, indexed, rendered by the tile engine of their metric and
+ * colored from the palette, markers last.
+ * 
+ * @param filePath 
+ * @return * Load 
+ */
+void LoadVoronoiImage(const char *filePath) 
+{
+    FILE *file = fopen(filePath, "rb");
+
+    if (file == NULL) {
+        fprintf(stderr, "ERROR: cannot read file %s: %s\n", filePath, strerror(errno));
+        exit(1);
+    }
+
+    size_t capacity = 1 << 16, size = 0, read;
+    uint8_t *bytes = malloc(capacity);
+    assert(bytes != NULL);
+    while ((read = fread(&bytes[size], 1, capacity - size, file)) > 0) {
+        size += read;
+        if (size == capacity) {
+            capacity *= 2;
+            bytes = realloc(bytes, capacity);
+            assert(bytes != NULL);
+        }
+    }
+    fclose(file);
+
+    const uint8_t *cursor = bytes + strlen(VOR_MAGIC);
+    const uint8_t *end = bytes + size;
+    uint64_t width, height, metric, markerRadius, markerColor, paletteCount, count;
+
+    if (size < strlen(VOR_MAGIC) || memcmp(bytes, VOR_MAGIC, strlen(VOR_MAGIC)) != 0
+        || !GetVarint(&cursor, end, &width) || !GetVarint(&cursor, end, &height)
+        || !GetVarint(&cursor, end, &metric) || !GetVarint(&cursor, end, &markerRadius)
+        || !GetVarint(&cursor, end, &markerColor) || !GetVarint(&cursor, end, &paletteCount)
+        || metric > METRIC_MANHATTAN || markerRadius > WIDTH + HEIGHT || paletteCount > (size_t)(end - cursor) / 3) {
+        fprintf(stderr, "ERROR: file %s is not a valid .vor image\n", filePath);
+        exit(1);
+    }
+    if (width != WIDTH || height != HEIGHT) {
+        fprintf(stderr, "ERROR: image %s is %llux%llu, expected %dx%d\n", filePath,
+                (unsigned long long)width, (unsigned long long)height, WIDTH, HEIGHT);
+        exit(1);
+    }
+
+    Color *palette = malloc((paletteCount + 1) * sizeof(Color));
+    assert(palette != NULL);
+    for (size_t p = 0; p < paletteCount; ++p) {
+        palette[p] = cursor[0] | cursor[1] << 8 | cursor[2] << 16;
+        cursor += 3;
+    }
+
+    if (!GetVarint(&cursor, end, &count) || count == 0 || count > (size_t)(end - cursor) / 2) {
+        fprintf(stderr, "ERROR: file %s is not a valid .vor image\n", filePath);
+        exit(1);
+    }
+
+    uint32_t side = HilbertSide(WIDTH, HEIGHT);
+    Vec2 *points = malloc(count * sizeof(Vec2));
+    Color *colors = malloc(count * sizeof(Color));
+    uint64_t position = 0;
+    int64_t expected = 0;
+    assert(points != NULL && colors != NULL);
+
+    for (size_t i = 0; i < count; ++i) {
+        uint64_t delta;
+        if (!GetVarint(&cursor, end, &delta) || delta >= (uint64_t)side * side - position) {
+            fprintf(stderr, "ERROR: file %s is not a valid .vor image\n", filePath);
+            exit(1);
+        }
+        position += delta;
+        points[i] = HilbertPoint(side, position);
+        if (points[i].x >= WIDTH || points[i].y >= HEIGHT) {
+            fprintf(stderr, "ERROR: file %s has a seed outside the image\n", filePath);
+            exit(1);
+        }
+    }
+    for (size_t i = 0; i < count; ++i) {
+        uint64_t zigzag;
+        if (!GetVarint(&cursor, end, &zigzag)) {
+            fprintf(stderr, "ERROR: file %s is not a valid .vor image\n", filePath);
+            exit(1);
+        }
+
+        int64_t paletteIdx = expected + (int64_t)(zigzag >> 1 ^ -(zigzag & 1));
+        if (paletteIdx < 0 || (uint64_t)paletteIdx >= paletteCount) {
+            fprintf(stderr, "ERROR: file %s has a seed without a palette entry\n", filePath);
+            exit(1);
+        }
+        colors[i] = palette[paletteIdx];
+        expected = paletteIdx + 1;
+    }
+    free(palette);
+    free(bytes);
+
+    Arena *arena = ThreadArena();
+    size_t mark = arena->used;
+    SeedGrid grid;
+
+    ProgressStage(STAGE_INDEX);
+    BuildSeedGrid(&grid, points, count, arena);
+    ProgressStage(STAGE_RENDER);
+    RenderVoronoiMetricWithGrid(&grid, (Metric)metric);
+    ArenaRewind(arena, mark);
+
+    ProgressStage(STAGE_COLOR);
+    #pragma omp parallel for schedule(static)
+    for (int y = 0; y < HEIGHT; ++y) {
+        for (int x = 0; x < WIDTH; ++x) {
+            image[y][x] = colors[labels[y][x]];
+        }
+    }
+    for (size_t i = 0; i < count && markerRadius > 0; ++i) {
+        FillCircle(points[i], (int)markerRadius, (Color)markerColor);
+    }
+
+    free(colors);
+    free(points);
+}
+
+/**
+ * @brief Render the Voronoi diagram of the jittered grid seeds for the image
+ * placed at an offset on the infinite canvas. No seeds are stored: the nine
+ * seeds around each run of pixels in one cell are rebuilt from the hash,
+ * and the run is scanned candidate by candidate so the pixels vectorize.
+ * Labels follow the order of GenerateJitteredSeeds, and ties go to the lower
+ * label, so the result matches RenderVoronoi over those seeds.
+ * 
+ * @param originX 
+ * @param originY 
+ * @return * Render 
+ */
+void RenderJittered(int64_t originX, int64_t originY) 
+{
+    int64_t firstCellX = FloorDiv(originX, JITTER_CELL_SIZE) - 1;
+    int64_t firstCellY = FloorDiv(originY, JITTER_CELL_SIZE) - 1;
+    int64_t cols = FloorDiv(originX + WIDTH - 1, JITTER_CELL_SIZE) + 2 - firstCellX;
+
+    #pragma omp parallel for schedule(static)
+    for (int y = 0; y < HEIGHT; ++y) {
+        int64_t pixelY = originY + y;
+        int64_t cellY = FloorDiv(pixelY, JITTER_CELL_SIZE);
+        int fy = (int)(pixelY - cellY * JITTER_CELL_SIZE);
+
+        for (int x = 0; x < WIDTH; ) {
+            int64_t pixelX = originX + x;
+            int64_t cellX = FloorDiv(pixelX, JITTER_CELL_SIZE);
+            int fx = (int)(pixelX - cellX * JITTER_CELL_SIZE);
+            int runLength = JITTER_CELL_SIZE - fx < WIDTH - x ? JITTER_CELL_SIZE - fx : WIDTH - x;
+            int candidatesX[9], candidatesY[9];
+            uint32_t candidateLabels[9];
+            Color candidateColors[9];
+            int bestDist[JITTER_CELL_SIZE];
+            int bestIdx[JITTER_CELL_SIZE];
+
+            for (int k = 0; k < 9; ++k) {
+                int64_t neighbourX = cellX + k % 3 - 1;
+                int64_t neighbourY = cellY + k / 3 - 1;
+                Vec2 offset = JitteredSeedOffset(neighbourX, neighbourY);
+
+                candidatesX[k] = (k % 3 - 1) * JITTER_CELL_SIZE + offset.x - fx;
+                candidatesY[k] = (k / 3 - 1) * JITTER_CELL_SIZE + offset.y - fy;
+                candidateLabels[k] = (neighbourY - firstCellY) * cols + (neighbourX - firstCellX);
+                candidateColors[k] = HashCell(neighbourX, neighbourY, 0x68E31DA4) | 0xFF000000;
+            }
+
+            for (int i = 0; i < runLength; ++i) {
+                bestDist[i] = INT32_MAX;
+                bestIdx[i] = 0;
+            }
+            for (int k = 0; k < 9; ++k) {
+                int cx = candidatesX[k], cy = candidatesY[k];
+
+                #pragma omp simd
+                for (int i = 0; i < runLength; ++i) {
+                    int dx = cx - i;
+                    int currDist = dx * dx + cy * cy;
+
+                    bestIdx[i] = currDist < bestDist[i] ? k : bestIdx[i];
+                    bestDist[i] = currDist < bestDist[i] ? currDist : bestDist[i];
+                }
+            }
+
+            for (int i = 0; i < runLength; ++i) {
+                labels[y][x + i] = candidateLabels[bestIdx[i]];
+                image[y][x + i] = candidateColors[bestIdx[i]];
+            }
+            x += runLength;
+        }
+    }
+}
+
+/**
+ * @brief Render fractal Worley noise: the sum over octaves of the distance to
+ * the closest jittered grid seed, each octave with its own cell size, gain
+ * and hash salt, scaled by the cell size and normalised by the total gain.
+ * All octaves are evaluated per row before the row is stored, so the result
+ * is written once. Pixel cells and in-cell positions are worked out once per
+ * octave, and every row hashes the seeds of its three cell rows per octave.
+ * Large cells scan their 3x3 candidates over runs of pixels sharing a cell;
+ * small cells, whose runs are too short, scan them over the whole row as one
+ * vector loop gathering each pixel's candidates. Square roots are taken in a
+ * separate loop so that neither scan has a libm call in it.
+ * 
+ * @param originX 
+ * @param originY 
+ * @param octavesCount At most OCTAVES_COUNT
+ * @param values WIDTH * HEIGHT values, mostly between 0 and 1
+ * @return * Render 
+ */
+void RenderWorleyFBM(int64_t originX, int64_t originY, size_t octavesCount, float *values) 
+{
+    static int pixelColumns[OCTAVES_COUNT][WIDTH];
+    static float pixelOffsets[OCTAVES_COUNT][WIDTH];
+    int64_t firstColumns[OCTAVES_COUNT];
+    float totalGain = 0;
+
+    assert(octavesCount <= OCTAVES_COUNT);
+    for (size_t o = 0; o < octavesCount; ++o) {
+        int cellSize = octaves[o].cellSize;
+
+        assert(FloorDiv(originX + WIDTH - 1, cellSize) - FloorDiv(originX, cellSize) + 3 <= FBM_MAX_COLUMNS);
+        firstColumns[o] = FloorDiv(originX, cellSize) - 1;
+        for (int x = 0; x < WIDTH; ++x) {
+            int64_t cellX = FloorDiv(originX + x, cellSize);
+            pixelColumns[o][x] = (int)(cellX - firstColumns[o]);
+            pixelOffsets[o][x] = (float)(originX + x - cellX * cellSize);
+        }
+        totalGain += octaves[o].gain;
+    }
+
+    #pragma omp parallel for schedule(static)
+    for (int y = 0; y < HEIGHT; ++y) {
+        float *row = &values[(size_t)y * WIDTH];
+        float seedsX[FBM_MAX_COLUMNS * 3], seedsY[FBM_MAX_COLUMNS * 3];
+        float closestDists[WIDTH];
+
+        for (int x = 0; x < WIDTH; ++x) {
+            row[x] = 0;
+        }
+
+        for (size_t o = 0; o < octavesCount; ++o) {
+            int cellSize = octaves[o].cellSize;
+            int64_t cellY = FloorDiv(originY + y, cellSize);
+            float offsetY = (float)(originY + y - cellY * cellSize);
+            int columns = pixelColumns[o][WIDTH - 1] + 2;
+            float low = cellSize * (1 - JITTER_AMOUNT) / 2;
+            float range = cellSize * JITTER_AMOUNT / 4294967296.0f;
+            float scale = octaves[o].gain / (cellSize * totalGain);
+            const int *cols = pixelColumns[o];
+            const float *offsets = pixelOffsets[o];
+
+            for (int c = 0; c < columns; ++c) {
+                int64_t cellX = firstColumns[o] + c;
+
+                for (int k = 0; k < 3; ++k) {
+                    uint32_t salt = (uint32_t)o * 0x9E3779B9u;
+                    seedsX[c * 3 + k] = low + HashCell(cellX, cellY + k - 1, salt ^ 0x51ED270B) * range;
+                    seedsY[c * 3 + k] = low + HashCell(cellX, cellY + k - 1, salt ^ 0x2545F491) * range + (k - 1) * cellSize;
+                }
+            }
+
+            if (cellSize >= FBM_RUN_MIN_CELL_SIZE) {
+                for (int x = 0; x < WIDTH; ) {
+                    int c = cols[x] - 1;
+                    int runEnd = x + 1;
+
+                    while (runEnd < WIDTH && cols[runEnd] == cols[x]) {
+                        ++runEnd;
+                    }
+                    for (int i = x; i < runEnd; ++i) {
+                        closestDists[i] = INFINITY;
+                    }
+                    for (int k = 0; k < 9; ++k) {
+                        float seedX = seedsX[(c + k / 3) * 3 + k % 3] + (k / 3 - 1) * cellSize;
+                        float dy = seedsY[(c + k / 3) * 3 + k % 3] - offsetY;
+
+                        #pragma omp simd
+                        for (int i = x; i < runEnd; ++i) {
+                            float dx = seedX - offsets[i];
+                            float currDist = dx * dx + dy * dy;
+
+                            closestDists[i] = currDist < closestDists[i] ? currDist : closestDists[i];
+                        }
+                    }
+                    x = runEnd;
+                }
+            } else {
+                #pragma omp simd
+                for (int x = 0; x < WIDTH; ++x) {
+                    int c = cols[x] - 1;
+                    float closestDist = INFINITY;
+
+                    #pragma GCC unroll 9
+                    for (int k = 0; k < 9; ++k) {
+                        float dx = seedsX[(c + k / 3) * 3 + k % 3] + (k / 3 - 1) * cellSize - offsets[x];
+                        float dy = seedsY[(c + k / 3) * 3 + k % 3] - offsetY;
+                        float currDist = dx * dx + dy * dy;
+
+                        closestDist = currDist < closestDist ? currDist : closestDist;
+                    }
+                    closestDists[x] = closestDist;
+                }
+            }
+            for (int x = 0; x < WIDTH; ++x) {
+                row[x] += sqrtf(closestDists[x]) * scale;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Save noise values as an 8-bit PGM, clamped to 0..1
+ * 
+ * @param filePath 
+ * @param values 
+ * @return * Save 
+ */
+void SaveValuesAsPGM(const char *filePath, const float *values) 
+{
+    FILE *file = fopen(filePath, "wb");
+
+    if (file == NULL) {
+        fprintf(stderr, "ERROR: cannot write into file %s: %s\n", filePath, strerror(errno));
+        exit(1);
+    }
+
+    uint8_t *bytes = malloc((size_t)WIDTH * HEIGHT);
+    assert(bytes != NULL);
+
+    #pragma omp parallel for schedule(static)
+    for (int y = 0; y < HEIGHT; ++y) {
+        for (int x = 0; x < WIDTH; ++x) {
+            float value = values[(size_t)y * WIDTH + x];
+            value = value < 0 ? 0 : value > 1 ? 1 : value;
+            bytes[(size_t)y * WIDTH + x] = (uint8_t)(value * 255 + 0.5f);
+        }
+    }
+
+    fprintf(file, "P5\n%d %d 255\n", WIDTH, HEIGHT);
+    fwrite(bytes, (size_t)WIDTH * HEIGHT, 1, file);
+    assert(!ferror(file));
+    ProgressBytes((uint64_t)WIDTH * HEIGHT);
+
+    int err = fclose(file);
+    assert(err == 0);
+    free(bytes);
+}
+
+/**
+ * @brief Save noise values unclamped as a greyscale little-endian PFM, whose
+ * rows go from bottom to top
+ * 
+ * @param filePath 
+ * @param values 
+ * @return * Save 
+ */
+void SaveValuesAsPFM(const char *filePath, const float *values) 
+{
+    FILE *file = fopen(filePath, "wb");
+
+    if (file == NULL) {
+        fprintf(stderr, "ERROR: cannot write into file %s: %s\n", filePath, strerror(errno));
+        exit(1);
+    }
+
+    uint16_t endianness = 1;
+    assert(*(uint8_t *)&endianness == 1);
+
+    fprintf(file, "Pf\n%d %d\n-1.0\n", WIDTH, HEIGHT);
+    for (int y = HEIGHT - 1; y >= 0; --y) {
+        fwrite(&values[(size_t)y * WIDTH], sizeof(float), WIDTH, file);
+    }
+    assert(!ferror(file));
+    ProgressBytes((uint64_t)WIDTH * HEIGHT * sizeof(float));
+
+    int err = fclose(file);
+    assert(err == 0);
+}
+
+/**
+ * @brief Collect the seeds that can own a pixel of a tile when the seeds sit
+ * at real positions and the grid holds them rounded: the radius around the
+ * tile centre gets one more pixel to cover the rounding. Returns 0 if the
+ * list does not fit.
+ * 
+ * @param grid 
+ * @param sites 
+ * @param tileX 
+ * @param tileY 
+ * @param tileSize 
+ * @param seedIdxs 
+ * @return size_t 
+ */
+size_t GatherSiteCandidates(const SeedGrid *grid, const Vec2d *sites, int tileX, int tileY, int tileSize, uint32_t *seedIdxs) 
+{
+    int tileWidth = tileX + tileSize < WIDTH ? tileSize : WIDTH - tileX;
+    int tileHeight = tileY + tileSize < HEIGHT ? tileSize : HEIGHT - tileY;
+    double centreX = tileX + (tileWidth - 1) * 0.5;
+    double centreY = tileY + (tileHeight - 1) * 0.5;
+    double halfDiagonal = sqrt((tileWidth - 1) * (tileWidth - 1) + (tileHeight - 1) * (tileHeight - 1)) * 0.5;
+
+    Vec2d closest = sites[NearestSeed(grid, centreX, centreY)];
+    double radius = hypot(closest.x - centreX, closest.y - centreY) + 2 * halfDiagonal + 1;
+
+    size_t count = GatherSeeds(grid, centreX, centreY, radius, seedIdxs, TILE_MAX_CANDIDATES);
+    if (count > TILE_MAX_CANDIDATES) {
+        return 0;
+    }
+
+    qsort(seedIdxs, count, sizeof(uint32_t), CompareSeedIdxs);
+    return count;
+}
+
+/**
+ * @brief Find the site closest to a pixel, for tiles whose candidate list
+ * overflowed
+ * 
+ * @param grid 
+ * @param sites 
+ * @param x 
+ * @param y 
+ * @param seedIdxs Room for TILE_MAX_CANDIDATES indices
+ * @return uint32_t 
+ */
+uint32_t NearestSite(const SeedGrid *grid, const Vec2d *sites, int x, int y, uint32_t *seedIdxs) 
+{
+    Vec2d closest = sites[NearestSeed(grid, x, y)];
+    size_t count = GatherSeeds(grid, x, y, hypot(closest.x - x, closest.y - y) + 1, seedIdxs, TILE_MAX_CANDIDATES);
+    uint32_t closestSeedIdx = 0;
+    double closestDist = INFINITY;
+
+    for (size_t i = 0; i < (count <= TILE_MAX_CANDIDATES ? count : grid->count); ++i) {
+        uint32_t seedIdx = count <= TILE_MAX_CANDIDATES ? seedIdxs[i] : i;
+        double dx = sites[seedIdx].x - x;
+        double dy = sites[seedIdx].y - y;
+        double currDist = dx * dx + dy * dy;
+
+        if (currDist < closestDist || (currDist == closestDist && seedIdx < closestSeedIdx)) {
+            closestDist = currDist;
+            closestSeedIdx = seedIdx;
+        }
+    }
+    return closestSeedIdx;
+}
+
+/**
+ * @brief Render the Voronoi diagram of sites at real positions into the label
+ * buffer and, in the same pass, accumulate the CVT energy, the sum of squared
+ * distances from every pixel to its site, and its gradient,
+ * 2 * (mass * site - sum of the cell's pixels) per site. Masses are returned
+ * too; site - gradient / (2 * mass) is the centroid of the cell.
+ * 
+ * @param sites 
+ * @param count 
+ * @param gradient 2 * count values
+ * @param masses 
+ * @return double 
+ */
+double EvaluateCVT(const Vec2d *sites, size_t count, double *gradient, double *masses) 
+{
+    Arena *arena = ThreadArena();
+    size_t mark = arena->used;
+    Vec2 *rounded = ArenaAlloc(arena, count * sizeof(Vec2));
+    double energy = 0;
+    SeedGrid grid;
+
+    for (size_t i = 0; i < count; ++i) {
+        rounded[i].x = (int)lround(sites[i].x);
+        rounded[i].y = (int)lround(sites[i].y);
+        masses[i] = 0;
+        gradient[2 * i] = gradient[2 * i + 1] = 0;
+    }
+    BuildSeedGrid(&grid, rounded, count, arena);
+
+    int tileSize = TileSizeForGrid(&grid);
+    int tilesX = (WIDTH + tileSize - 1) / tileSize;
+    int tilesY = (HEIGHT + tileSize - 1) / tileSize;
+
+    #pragma omp parallel for schedule(dynamic) reduction(+:energy)
+    for (int tile = 0; tile < tilesX * tilesY; ++tile) {
+        TileBuffer *buffer = PoolAlloc(ThreadTilePool(), sizeof(TileBuffer));
+        uint32_t *seedIdxs = buffer->seedIdxs;
+        int tileX = tile % tilesX * tileSize;
+        int tileY = tile / tilesX * tileSize;
+        int endX = tileX + tileSize < WIDTH ? tileX + tileSize : WIDTH;
+        int endY = tileY + tileSize < HEIGHT ? tileY + tileSize : HEIGHT;
+        size_t candidatesCount = GatherSiteCandidates(&grid, sites, tileX, tileY, tileSize, seedIdxs);
+        double tileMasses[TILE_MAX_CANDIDATES] = {0};
+        double tileSumsX[TILE_MAX_CANDIDATES] = {0};
+        double tileSumsY[TILE_MAX_CANDIDATES] = {0};
+
+        for (int y = tileY; y < endY; ++y) {
+            for (int x = tileX; x < endX; ++x) {
+                if (candidatesCount == 0) {
+                    uint32_t seedIdx = NearestSite(&grid, sites, x, y, seedIdxs);
+                    double dx = sites[seedIdx].x - x, dy = sites[seedIdx].y - y;
+
+                    labels[y][x] = seedIdx;
+                    energy += dx * dx + dy * dy;
+                    #pragma omp atomic
+                    masses[seedIdx] += 1;
+                    #pragma omp atomic
+                    gradient[2 * seedIdx] += 2 * dx;
+                    #pragma omp atomic
+                    gradient[2 * seedIdx + 1] += 2 * dy;
+                    continue;
+                }
+
+                size_t closestIdx = 0;
+                double closestDist = INFINITY;
+
+                for (size_t i = 0; i < candidatesCount; ++i) {
+                    double dx = sites[seedIdxs[i]].x - x;
+                    double dy = sites[seedIdxs[i]].y - y;
+                    double currDist = dx * dx + dy * dy;
+
+                    if (currDist < closestDist) {
+                        closestDist = currDist;
+                        closestIdx = i;
+                    }
+                }
+
+                labels[y][x] = seedIdxs[closestIdx];
+                energy += closestDist;
+                tileMasses[closestIdx] += 1;
+                tileSumsX[closestIdx] += x;
+                tileSumsY[closestIdx] += y;
+            }
+        }
+
+        for (size_t i = 0; i < candidatesCount; ++i) {
+            if (tileMasses[i] > 0) {
+                uint32_t seedIdx = seedIdxs[i];
+                #pragma omp atomic
+                masses[seedIdx] += tileMasses[i];
+                #pragma omp atomic
+                gradient[2 * seedIdx] += 2 * (tileMasses[i] * sites[seedIdx].x - tileSumsX[i]);
+                #pragma omp atomic
+                gradient[2 * seedIdx + 1] += 2 * (tileMasses[i] * sites[seedIdx].y - tileSumsY[i]);
+            }
+        }
+
+        PoolFree(ThreadTilePool(), buffer);
+    }
+
+    ArenaRewind(arena, mark);
+    return energy;
+}
+
+/**
+ * @brief Keep the sites inside the image
+ * 
+ * @param sites 
+ * @param count 
+ * @return * Clamp 
+ */
+void ClampSites(Vec2d *sites, size_t count) 
+{
+    for (size_t i = 0; i < count; ++i) {
+        sites[i].x = sites[i].x < 0 ? 0 : sites[i].x > WIDTH - 1 ? WIDTH - 1 : sites[i].x;
+        sites[i].y = sites[i].y < 0 ? 0 : sites[i].y > HEIGHT - 1 ? HEIGHT - 1 : sites[i].y;
+    }
+}
+
+/**
+ * @brief Print one line of CVT progress, energy given per pixel
+ * 
+ * @param log 
+ * @param method 
+ * @param passes 
+ * @param begin 
+ * @param energy 
+ * @return * Report 
+ */
+void ReportCVTProgress(FILE *log, const char *method, size_t passes, const struct timespec *begin, double energy) 
+{
+    struct timespec now;
+
+    if (log == NULL) {
+        return;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    fprintf(log, "%-6s %5zu passes %9.1f ms  energy %.6f\n", method, passes,
+            ((now.tv_sec - begin->tv_sec) + (now.tv_nsec - begin->tv_nsec) * 1e-9) * 1e3,
+            energy / ((double)WIDTH * HEIGHT));
+}
+
+/**
+ * @brief Relax sites with Lloyd iterations, moving every site to the centroid
+ * of its cell after each full pass
+ * 
+ * @param sites 
+ * @param count 
+ * @param maxPasses 
+ * @param log Progress output, or NULL
+ * @return double Final energy
+ */
+double RelaxLloyd(Vec2d *sites, size_t count, size_t maxPasses, FILE *log) 
+{
+    double *gradient = malloc(2 * count * sizeof(double));
+    double *masses = malloc(count * sizeof(double));
+    double energy = INFINITY;
+    struct timespec begin;
+    assert(gradient != NULL && masses != NULL);
+
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    for (size_t pass = 1; pass <= maxPasses; ++pass) {
+        energy = EvaluateCVT(sites, count, gradient, masses);
+        for (size_t i = 0; i < count; ++i) {
+            if (masses[i] > 0) {
+                sites[i].x -= gradient[2 * i] / (2 * masses[i]);
+                sites[i].y -= gradient[2 * i + 1] / (2 * masses[i]);
+            }
+        }
+        if (pass % CVT_REPORT_EVERY == 0 || pass == maxPasses) {
+            ReportCVTProgress(log, "lloyd", pass, &begin, energy);
+        }
+    }
+
+    free(gradient);
+    free(masses);
+    return energy;
+}
+
+/**
+ * @brief Relax sites with L-BFGS on the CVT energy until it drops to a target
+ * or the passes run out. The initial inverse Hessian is diag(1 / (2 * mass)),
+ * so an empty history gives a Lloyd step. Every energy evaluation of the
+ * backtracking line search is one full pass.
+ * 
+ * @param sites 
+ * @param count 
+ * @param maxPasses 
+ * @param targetEnergy 
+ * @param log Progress output, or NULL
+ * @return size_t Passes used
+ */
+size_t RelaxLBFGS(Vec2d *sites, size_t count, size_t maxPasses, double targetEnergy, FILE *log) 
+{
+    size_t n = 2 * count;
+    double *buffer = malloc((6 + 2 * CVT_HISTORY) * n * sizeof(double) + count * sizeof(double));
+    assert(buffer != NULL);
+
+    double *gradient = buffer, *trialGradient = buffer + n, *direction = buffer + 2 * n;
+    double *scale = buffer + 3 * n, *previous = buffer + 4 * n, *trialMasses = buffer + 5 * n;
+    double *historyS = buffer + 6 * n, *historyY = historyS + CVT_HISTORY * n;
+    double *masses = historyY + CVT_HISTORY * n;
+    double rho[CVT_HISTORY], alpha[CVT_HISTORY];
+    size_t historyCount = 0, historyNext = 0, passes = 1;
+    struct timespec begin;
+
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    double energy = EvaluateCVT(sites, count, gradient, masses);
+
+    while (passes < maxPasses && energy > targetEnergy) {
+        for (size_t i = 0; i < n; ++i) {
+            scale[i] = 1 / (2 * (masses[i / 2] > 1 ? masses[i / 2] : 1));
+            direction[i] = -gradient[i];
+        }
+
+        for (size_t k = 0; k < historyCount; ++k) {
+            size_t h = (historyNext + CVT_HISTORY - 1 - k) % CVT_HISTORY;
+            double dot = 0;
+            for (size_t i = 0; i < n; ++i) {
+                dot += historyS[h * n + i] * direction[i];
+            }
+            alpha[h] = rho[h] * dot;
+            for (size_t i = 0; i < n; ++i) {
+                direction[i] -= alpha[h] * historyY[h * n + i];
+            }
+        }
+        for (size_t i = 0; i < n; ++i) {
+            direction[i] *= scale[i];
+        }
+        for (size_t k = historyCount; k > 0; --k) {
+            size_t h = (historyNext + CVT_HISTORY - k) % CVT_HISTORY;
+            double dot = 0;
+            for (size_t i = 0; i < n; ++i) {
+                dot += historyY[h * n + i] * direction[i];
+            }
+            for (size_t i = 0; i < n; ++i) {
+                direction[i] += (alpha[h] - rho[h] * dot) * historyS[h * n + i];
+            }
+        }
+
+        double slope = 0;
+        for (size_t i = 0; i < n; ++i) {
+            slope += gradient[i] * direction[i];
+        }
+        if (slope >= 0) {
+            historyCount = 0;
+            for (size_t i = 0; i < n; ++i) {
+                direction[i] = -gradient[i] * scale[i];
+            }
+            slope = 0;
+            for (size_t i = 0; i < n; ++i) {
+                slope += gradient[i] * direction[i];
+            }
+        }
+
+        memcpy(previous, sites, count * sizeof(Vec2d));
+        double step = 1, trialEnergy = INFINITY;
+        for (int halving = 0; halving <= CVT_MAX_HALVINGS && passes < maxPasses; ++halving, step *= 0.5) {
+            for (size_t i = 0; i < count; ++i) {
+                sites[i].x = previous[2 * i] + step * direction[2 * i];
+                sites[i].y = previous[2 * i + 1] + step * direction[2 * i + 1];
+            }
+            ClampSites(sites, count);
+            trialEnergy = EvaluateCVT(sites, count, trialGradient, trialMasses);
+            ++passes;
+            if (trialEnergy <= energy + 1e-4 * step * slope) {
+                break;
+            }
+        }
+        if (trialEnergy >= energy) {
+            memcpy(sites, previous, count * sizeof(Vec2d));
+            break;
+        }
+
+        double sy = 0, yy = 0;
+        double *s = &historyS[historyNext * n], *y = &historyY[historyNext * n];
+        for (size_t i = 0; i < count; ++i) {
+            s[2 * i] = sites[i].x - previous[2 * i];
+            s[2 * i + 1] = sites[i].y - previous[2 * i + 1];
+        }
+        for (size_t i = 0; i < n; ++i) {
+            y[i] = trialGradient[i] - gradient[i];
+            sy += s[i] * y[i];
+            yy += y[i] * y[i];
+        }
+        if (sy > 1e-10 * yy) {
+            rho[historyNext] = 1 / sy;
+            historyNext = (historyNext + 1) % CVT_HISTORY;
+            historyCount += historyCount < CVT_HISTORY;
+        }
+
+        energy = trialEnergy;
+        memcpy(gradient, trialGradient, n * sizeof(double));
+        memcpy(masses, trialMasses, count * sizeof(double));
+        if (passes / CVT_REPORT_EVERY != (passes - 1) / CVT_REPORT_EVERY || energy <= targetEnergy) {
+            ReportCVTProgress(log, "l-bfgs", passes, &begin, energy);
+        }
+    }
+
+    free(buffer);
+    return passes;
+}
+
+/**
+ * @brief Copy the seeds into real-valued sites
+ * 
+ * @param sites 
+ * @return * Copy 
+ */
+void SeedsToSites(Vec2d *sites) 
+{
+    for (size_t i = 0; i < SEEDS_COUNT; ++i) {
+        sites[i].x = seeds[i].x;
+        sites[i].y = seeds[i].y;
+    }
+}
+
+/**
+ * @brief Compare Lloyd and L-BFGS from the same random seeds: Lloyd runs for
+ * CVT_PASSES passes, then L-BFGS runs until it reaches the same energy
+ * 
+ * @return * Benchmark 
+ */
+void BenchCVT() 
+{
+    Vec2d *sites = malloc(SEEDS_COUNT * sizeof(Vec2d));
+    struct timespec begin, end;
+    assert(sites != NULL);
+
+    printf("cvt: %d seeds, %dx%d\n", SEEDS_COUNT, WIDTH, HEIGHT);
+    SeedsToSites(sites);
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    double lloydEnergy = RelaxLloyd(sites, SEEDS_COUNT, CVT_PASSES, stdout);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double lloydSeconds = (end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) * 1e-9;
+
+    SeedsToSites(sites);
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    size_t passes = RelaxLBFGS(sites, SEEDS_COUNT, CVT_PASSES, lloydEnergy, stdout);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double lbfgsSeconds = (end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) * 1e-9;
+
+    printf("cvt: lloyd %d passes in %.1f ms, l-bfgs %zu passes in %.1f ms to energy %.6f\n",
+           CVT_PASSES, lloydSeconds * 1e3, passes, lbfgsSeconds * 1e3, lloydEnergy / ((double)WIDTH * HEIGHT));
+    free(sites);
+}
+
+/**
+ * @brief Time the exact tile engine against bounded-error previews on the
+ * same grid, each the best of BENCH_REPEATS runs. Reports the share of pixels
+ * whose seed differs from the exact one, and the worst ratio of the chosen to
+ * the closest distance, which must stay within 1 + epsilon.
+ * 
+ * @return * Benchmark 
+ */
+void BenchApproximate() 
+{
+    static const double epsilons[] = {0.05, 0.1, 0.25, 0.5, 1.0};
+    Arena *arena = ThreadArena();
+    size_t mark = arena->used;
+    uint32_t *exact = malloc(sizeof(labels));
+    struct timespec begin, end;
+    SeedGrid grid;
+    double exactSeconds = INFINITY;
+    assert(exact != NULL);
+
+    BuildSeedGrid(&grid, seeds, SEEDS_COUNT, arena);
+    for (int repeat = 0; repeat < BENCH_REPEATS; ++repeat) {
+        clock_gettime(CLOCK_MONOTONIC, &begin);
+        RenderVoronoiWithGrid(&grid, NULL);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        exactSeconds = fmin(exactSeconds, (end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) * 1e-9);
+    }
+    memcpy(exact, labels, sizeof(labels));
+    printf("approximate: exact render %.2f ms\n", exactSeconds * 1e3);
+
+    for (size_t e = 0; e < sizeof(epsilons) / sizeof(epsilons[0]); ++e) {
+        double seconds = INFINITY;
+        for (int repeat = 0; repeat < BENCH_REPEATS; ++repeat) {
+            clock_gettime(CLOCK_MONOTONIC, &begin);
+            RenderVoronoiApproximateWithGrid(&grid, epsilons[e]);
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            seconds = fmin(seconds, (end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) * 1e-9);
+        }
+
+        size_t mislabelled = 0;
+        double worstRatio = 1;
+        for (int y = 0; y < HEIGHT; ++y) {
+            for (int x = 0; x < WIDTH; ++x) {
+                uint32_t closestIdx = exact[(size_t)y * WIDTH + x];
+                if (labels[y][x] != closestIdx) {
+                    Vec2 point = {x, y};
+                    double closestDist = sqrt(SquareDistance(seeds[closestIdx], point));
+                    double chosenDist = sqrt(SquareDistance(seeds[labels[y][x]], point));
+                    worstRatio = closestDist > 0 ? fmax(worstRatio, chosenDist / closestDist) : INFINITY;
+                    ++mislabelled;
+                }
+            }
+        }
+
+        printf("approximate: epsilon %.2f render %.2f ms, %.2fx faster, %.3f%% mislabelled, worst distance ratio %.4f\n",
+               epsilons[e], seconds * 1e3, exactSeconds / seconds, mislabelled * 100.0 / ((double)WIDTH * HEIGHT), worstRatio);
+    }
+
+    free(exact);
+    ArenaRewind(arena, mark);
+}
+
+/**
+ * @brief Load a PGM density map matching the image size, scaled so that its
+ * mean is 1
+ * 
+ * @param filePath 
+ * @return float* WIDTH * HEIGHT densities, to be freed by the caller
+ */
+float *LoadDensityPGM(const char *filePath) 
+{
+    FILE *file = fopen(filePath, "rb");
+
+    if (file == NULL) {
+        fprintf(stderr, "ERROR: cannot read file %s: %s\n", filePath, strerror(errno));
+        exit(1);
+    }
+
+    char magic[2];
+    if (fread(magic, 1, 2, file) != 2 || magic[0] != 'P' || (magic[1] != '2' && magic[1] != '5')) {
+        fprintf(stderr, "ERROR: file %s is not a PGM image\n", filePath);
+        exit(1);
+    }
+
+    int width = ReadPBMNumber(file);
+    int height = ReadPBMNumber(file);
+    int maxValue = ReadPBMNumber(file);
+    if (width != WIDTH || height != HEIGHT) {
+        fprintf(stderr, "ERROR: density %s is %dx%d, expected %dx%d\n", filePath, width, height, WIDTH, HEIGHT);
+        exit(1);
+    }
+    if (maxValue <= 0 || maxValue > 65535) {
+        fprintf(stderr, "ERROR: density %s has an invalid maximum value\n", filePath);
+        exit(1);
+    }
+
+    float *density = malloc((size_t)WIDTH * HEIGHT * sizeof(float));
+    double total = 0;
+    assert(density != NULL);
+
+    for (size_t i = 0; i < (size_t)WIDTH * HEIGHT; ++i) {
+        int value;
+        if (magic[1] == '2') {
+            value = ReadPBMNumber(file);
+        } else if (maxValue < 256) {
+            value = fgetc(file);
+        } else {
+            int high = fgetc(file);
+            value = high < 0 ? -1 : (high << 8) | fgetc(file);
+        }
+        if (value < 0) {
+            fprintf(stderr, "ERROR: density %s is truncated\n", filePath);
+            exit(1);
+        }
+        density[i] = value;
+        total += value;
+    }
+    fclose(file);
+
+    if (total <= 0) {
+        fprintf(stderr, "ERROR: density %s is zero everywhere\n", filePath);
+        exit(1);
+    }
+    for (size_t i = 0; i < (size_t)WIDTH * HEIGHT; ++i) {
+        density[i] *= (double)WIDTH * HEIGHT / total;
+    }
+    return density;
+}
+
+/**
+ * @brief Squared distance between two closed intervals on a line
+ * 
+ * @param beginA 
+ * @param endA 
+ * @param beginB 
+ * @param endB 
+ * @return double 
+ */
+double IntervalGap(double beginA, double endA, double beginB, double endB) 
+{
+    double gap = beginB > endA ? beginB - endA : beginA > endB ? beginA - endB : 0;
+    return gap * gap;
+}
+
+/**
+ * @brief Collect the seeds that can own a pixel of a tile in the power diagram
+ * of the weights, where a pixel belongs to the seed minimizing the squared
+ * distance minus the weight. The seeds around the tile centre bound the power
+ * of every pixel, and a grid cell or seed whose squared distance to the tile
+ * minus its largest weight exceeds that bound cannot win any pixel. Returns 0
+ * if the list does not fit.
+ * 
+ * @param grid 
+ * @param weights 
+ * @param cellMaxWeights Largest weight of the seeds of every grid cell
+ * @param maxWeight 
+ * @param tileX 
+ * @param tileY 
+ * @param tileSize 
+ * @param seedIdxs 
+ * @return size_t 
+ */
+size_t GatherPowerCandidates(const SeedGrid *grid, const double *weights, const double *cellMaxWeights, double maxWeight, int tileX, int tileY, int tileSize, uint32_t *seedIdxs) 
+{
+    int lastX = (tileX + tileSize < WIDTH ? tileX + tileSize : WIDTH) - 1;
+    int lastY = (tileY + tileSize < HEIGHT ? tileY + tileSize : HEIGHT) - 1;
+    double centreX = (tileX + lastX) * 0.5;
+    double centreY = (tileY + lastY) * 0.5;
+    double halfDiagonal = hypot(lastX - tileX, lastY - tileY) * 0.5;
+
+    uint32_t closestIdx = NearestSeed(grid, centreX, centreY);
+    Vec2 closest = grid->points[closestIdx];
+    double nearbyRadius = hypot(closest.x - centreX, closest.y - centreY) + grid->cellSize;
+    size_t nearbyCount = GatherSeeds(grid, centreX, centreY, nearbyRadius, seedIdxs, TILE_MAX_CANDIDATES);
+    double bound = INFINITY;
+
+    for (size_t i = 0; i < (nearbyCount < TILE_MAX_CANDIDATES ? nearbyCount : TILE_MAX_CANDIDATES); ++i) {
+        Vec2 seed = grid->points[seedIdxs[i]];
+        double reach = hypot(seed.x - centreX, seed.y - centreY) + halfDiagonal;
+        bound = fmin(bound, reach * reach - weights[seedIdxs[i]]);
+    }
+    bound += 1e-6 * (fabs(bound) + 1);
+
+    double radius = sqrt(fmax(bound + maxWeight, 0)) + halfDiagonal;
+    int beginCol = (int)floor((centreX - radius - grid->originX) / grid->cellSize);
+    int endCol = (int)floor((centreX + radius - grid->originX) / grid->cellSize);
+    int beginRow = (int)floor((centreY - radius - grid->originY) / grid->cellSize);
+    int endRow = (int)floor((centreY + radius - grid->originY) / grid->cellSize);
+    beginCol = beginCol < 0 ? 0 : beginCol;
+    beginRow = beginRow < 0 ? 0 : beginRow;
+    endCol = endCol < grid->cols ? endCol : grid->cols - 1;
+    endRow = endRow < grid->rows ? endRow : grid->rows - 1;
+
+    size_t count = 0;
+    for (int row = beginRow; row <= endRow; ++row) {
+        double cellY = grid->originY + (double)row * grid->cellSize;
+        double rowGap = IntervalGap(cellY, cellY + grid->cellSize - 1, tileY, lastY);
+
+        for (int col = beginCol; col <= endCol; ++col) {
+            size_t cell = (size_t)row * grid->cols + col;
+            double cellX = grid->originX + (double)col * grid->cellSize;
+
+            if (rowGap + IntervalGap(cellX, cellX + grid->cellSize - 1, tileX, lastX) - cellMaxWeights[cell] > bound) {
+                continue;
+            }
+
+            for (uint32_t i = grid->cellStart[cell]; i < grid->cellStart[cell + 1]; ++i) {
+                uint32_t seedIdx = grid->cellSeeds[i];
+                Vec2 seed = grid->points[seedIdx];
+
+                if (IntervalGap(seed.x, seed.x, tileX, lastX) + IntervalGap(seed.y, seed.y, tileY, lastY) - weights[seedIdx] <= bound) {
+                    if (count == TILE_MAX_CANDIDATES) {
+                        return 0;
+                    }
+                    seedIdxs[count++] = seedIdx;
+                }
+            }
+        }
+    }
+
+    qsort(seedIdxs, count, sizeof(uint32_t), CompareSeedIdxs);
+    return count;
+}
+
+/**
+ * @brief Find the seed of a pixel in the power diagram by scanning every seed,
+ * for tiles whose candidate list overflowed
+ * 
+ * @param grid 
+ * @param weights 
+ * @param x 
+ * @param y 
+ * @return uint32_t 
+ */
+uint32_t NearestPowerSeed(const SeedGrid *grid, const double *weights, int x, int y) 
+{
+    uint32_t closestSeedIdx = 0;
+    double closestPower = INFINITY;
+
+    for (size_t i = 0; i < grid->count; ++i) {
+        double dx = grid->points[i].x - x;
+        double dy = grid->points[i].y - y;
+        double currPower = dx * dx + dy * dy - weights[i];
+
+        if (currPower < closestPower) {
+            closestPower = currPower;
+            closestSeedIdx = i;
+        }
+    }
+    return closestSeedIdx;
+}
+
+/**
+ * @brief Render the power diagram of the seeds held by a grid into the label
+ * buffer and sum the density of every cell in the same tile-parallel pass
+ * 
+ * @param grid 
+ * @param weights 
+ * @param density Density per pixel, or NULL for uniform
+ * @param capacities 
+ * @return double Integral of the density times the power of every pixel to
+ * its seed
+ */
+double RenderPowerDiagram(const SeedGrid *grid, const double *weights, const float *density, double *capacities) 
+{
+    int tileSize = TileSizeForGrid(grid);
+    int tilesX = (WIDTH + tileSize - 1) / tileSize;
+    int tilesY = (HEIGHT + tileSize - 1) / tileSize;
+    double maxWeight = -INFINITY;
+    double integral = 0;
+    Arena *arena = ThreadArena();
+    size_t mark = arena->used;
+    size_t cellsCount = (size_t)grid->cols * grid->rows;
+    double *cellMaxWeights = ArenaAlloc(arena, cellsCount * sizeof(double));
+
+    for (size_t cell = 0; cell < cellsCount; ++cell) {
+        cellMaxWeights[cell] = -INFINITY;
+        for (uint32_t i = grid->cellStart[cell]; i < grid->cellStart[cell + 1]; ++i) {
+            cellMaxWeights[cell] = fmax(cellMaxWeights[cell], weights[grid->cellSeeds[i]]);
+        }
+        maxWeight = cellMaxWeights[cell] > maxWeight ? cellMaxWeights[cell] : maxWeight;
+    }
+    memset(capacities, 0, grid->count * sizeof(double));
+
+    #pragma omp parallel for schedule(dynamic) reduction(+:integral)
+    for (int tile = 0; tile < tilesX * tilesY; ++tile) {
+        TileBuffer *buffer = PoolAlloc(ThreadTilePool(), sizeof(TileBuffer));
+        uint32_t *seedIdxs = buffer->seedIdxs;
+        int *candidatesX = buffer->candidatesX;
+        int *candidatesY = buffer->candidatesY;
+        int tileX = tile % tilesX * tileSize;
+        int tileY = tile / tilesX * tileSize;
+        int endX = tileX + tileSize < WIDTH ? tileX + tileSize : WIDTH;
+        int endY = tileY + tileSize < HEIGHT ? tileY + tileSize : HEIGHT;
+        size_t count = GatherPowerCandidates(grid, weights, cellMaxWeights, maxWeight, tileX, tileY, tileSize, seedIdxs);
+        double candidateWeights[TILE_MAX_CANDIDATES];
+        double tileCapacities[TILE_MAX_CANDIDATES] = {0};
+
+        for (size_t i = 0; i < count; ++i) {
+            candidatesX[i] = grid->points[seedIdxs[i]].x;
+            candidatesY[i] = grid->points[seedIdxs[i]].y;
+            candidateWeights[i] = weights[seedIdxs[i]];
+        }
+
+        for (int y = tileY; y < endY; ++y) {
+            for (int x = tileX; x < endX; ++x) {
+                double pixelCapacity = density != NULL ? density[(size_t)y * WIDTH + x] : 1;
+
+                if (count == 0) {
+                    uint32_t seedIdx = NearestPowerSeed(grid, weights, x, y);
+                    double dx = grid->points[seedIdx].x - x;
+                    double dy = grid->points[seedIdx].y - y;
+                    labels[y][x] = seedIdx;
+                    integral += pixelCapacity * (dx * dx + dy * dy - weights[seedIdx]);
+                    #pragma omp atomic
+                    capacities[seedIdx] += pixelCapacity;
+                    continue;
+                }
+
+                size_t closestIdx = 0;
+                double closestPower = INFINITY;
+
+                for (size_t i = 0; i < count; ++i) {
+                    int dx = candidatesX[i] - x;
+                    int dy = candidatesY[i] - y;
+                    double currPower = dx * dx + dy * dy - candidateWeights[i];
+
+                    if (currPower < closestPower) {
+                        closestPower = currPower;
+                        closestIdx = i;
+                    }
+                }
+
+                labels[y][x] = seedIdxs[closestIdx];
+                tileCapacities[closestIdx] += pixelCapacity;
+                integral += pixelCapacity * closestPower;
+            }
+        }
+
+        for (size_t i = 0; i < count; ++i) {
+            if (tileCapacities[i] > 0) {
+                #pragma omp atomic
+                capacities[seedIdxs[i]] += tileCapacities[i];
+            }
+        }
+
+        PoolFree(ThreadTilePool(), buffer);
+    }
+
+    ArenaRewind(arena, mark);
+    return integral;
+}
+
+/**
+ * @brief Order cell adjacencies by their pair of labels
+ * 
+ * @param a 
+ * @param b 
+ * @return int 
+ */
+int CompareCellAdjacencies(const void *a, const void *b) 
+{
+    uint64_t keyA = ((const CellAdjacency *)a)->key;
+    uint64_t keyB = ((const CellAdjacency *)b)->key;
+    return (keyA > keyB) - (keyA < keyB);
+}
+
+/**
+ * @brief Measure the derivative of the capacities with respect to the power
+ * weights from the label buffer. Raising a weight moves every edge of the
+ * cell outwards by the weight change over twice the distance to the
+ * neighbour, so each pair of adjacent cells is coupled by its boundary
+ * capacity over twice their distance. Pixel pairs straddling the boundary
+ * are counted and merged per pair of cells; a boundary of length l crosses
+ * l * (|dx| + |dy|) / d pixel pairs when the seeds are dx, dy apart.
+ * 
+ * @param density Density per pixel, or NULL for uniform
+ * @param adjacencies Growable list, reallocated as needed
+ * @param capacity Allocated length of the list
+ * @return size_t Number of distinct pairs of adjacent cells
+ */
+size_t MeasureCellAdjacencies(const float *density, CellAdjacency **adjacencies, size_t *capacity) 
+{
+    size_t count = 0;
+
+    for (int y = 0; y < HEIGHT; ++y) {
+        for (int x = 0; x < WIDTH; ++x) {
+            for (int side = 0; side < 2; ++side) {
+                int otherX = x + (side == 0);
+                int otherY = y + (side == 1);
+                if (otherX >= WIDTH || otherY >= HEIGHT || labels[y][x] == labels[otherY][otherX]) {
+                    continue;
+                }
+
+                uint32_t low = labels[y][x] < labels[otherY][otherX] ? labels[y][x] : labels[otherY][otherX];
+                uint32_t high = labels[y][x] ^ labels[otherY][otherX] ^ low;
+                uint64_t key = (uint64_t)low << 32 | high;
+                double weight = density != NULL
+                    ? 0.5 * (density[(size_t)y * WIDTH + x] + density[(size_t)otherY * WIDTH + otherX])
+                    : 1;
+
+                if (count > 0 && (*adjacencies)[count - 1].key == key) {
+                    (*adjacencies)[count - 1].weight += weight;
+                    continue;
+                }
+                if (count == *capacity) {
+                    *capacity = *capacity > 0 ? *capacity * 2 : 1024;
+                    *adjacencies = realloc(*adjacencies, *capacity * sizeof(CellAdjacency));
+                    assert(*adjacencies != NULL);
+                }
+                (*adjacencies)[count].key = key;
+                (*adjacencies)[count].weight = weight;
+                ++count;
+            }
+        }
+    }
+
+    CellAdjacency *list = *adjacencies;
+    qsort(list, count, sizeof(CellAdjacency), CompareCellAdjacencies);
+
+    size_t merged = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (merged > 0 && list[merged - 1].key == list[i].key) {
+            list[merged - 1].weight += list[i].weight;
+        } else {
+            list[merged++] = list[i];
+        }
+    }
+
+    for (size_t i = 0; i < merged; ++i) {
+        Vec2 a = seeds[list[i].key >> 32];
+        Vec2 b = seeds[list[i].key & UINT32_MAX];
+        list[i].weight /= 2 * fmax(abs(a.x - b.x) + abs(a.y - b.y), 1);
+    }
+    return merged;
+}
+
+/**
+ * @brief Multiply a vector of weights by the capacity derivative, the graph
+ * Laplacian of the cell adjacencies plus a diagonal regularization
+ * 
+ * @param adjacencies 
+ * @param adjacenciesCount 
+ * @param regularization 
+ * @param in 
+ * @param out 
+ * @return * Multiply 
+ */
+void ApplyCapacityJacobian(const CellAdjacency *adjacencies, size_t adjacenciesCount, const double *regularization, const double *in, double *out) 
+{
+    for (size_t i = 0; i < SEEDS_COUNT; ++i) {
+        out[i] = regularization[i] * in[i];
+    }
+    for (size_t i = 0; i < adjacenciesCount; ++i) {
+        uint32_t a = adjacencies[i].key >> 32;
+        uint32_t b = adjacencies[i].key & UINT32_MAX;
+        double flow = adjacencies[i].weight * (in[a] - in[b]);
+        out[a] += flow;
+        out[b] -= flow;
+    }
+}
+
+/**
+ * @brief Solve for the Newton step of the power weights, the change that the
+ * measured capacity derivative predicts to remove the capacity errors, with
+ * Jacobi-preconditioned conjugate gradients. Cells that vanished have no
+ * neighbours, and are regularized so that they grow by their error, which
+ * the remaining cells give up evenly since the Laplacian cannot absorb it.
+ * 
+ * @param adjacencies 
+ * @param adjacenciesCount 
+ * @param errors Target minus measured capacity of every cell
+ * @param step 
+ * @param scratch Room for 5 * SEEDS_COUNT doubles
+ * @return * Solve 
+ */
+void SolveCapacityStep(const CellAdjacency *adjacencies, size_t adjacenciesCount, const double *errors, double *step, double *scratch) 
+{
+    double *regularization = scratch;
+    double *diagonal = scratch + SEEDS_COUNT;
+    double *residual = scratch + 2 * SEEDS_COUNT;
+    double *direction = scratch + 3 * SEEDS_COUNT;
+    double *product = scratch + 4 * SEEDS_COUNT;
+    double meanDiagonal = 0;
+
+    memset(diagonal, 0, SEEDS_COUNT * sizeof(double));
+    for (size_t i = 0; i < adjacenciesCount; ++i) {
+        diagonal[adjacencies[i].key >> 32] += adjacencies[i].weight;
+        diagonal[adjacencies[i].key & UINT32_MAX] += adjacencies[i].weight;
+        meanDiagonal += 2 * adjacencies[i].weight / SEEDS_COUNT;
+    }
+    for (size_t i = 0; i < SEEDS_COUNT; ++i) {
+        regularization[i] = diagonal[i] > 0 ? meanDiagonal * 1e-6 : 1;
+        diagonal[i] += regularization[i];
+    }
+
+    double vanishedError = 0;
+    size_t connectedCount = 0;
+    for (size_t i = 0; i < SEEDS_COUNT; ++i) {
+        if (regularization[i] == 1) {
+            vanishedError += errors[i];
+        } else {
+            ++connectedCount;
+        }
+    }
+
+    double residualNorm = 0;
+    double errorNorm = 0;
+    for (size_t i = 0; i < SEEDS_COUNT; ++i) {
+        step[i] = 0;
+        residual[i] = regularization[i] == 1 || connectedCount == 0 ? errors[i] : errors[i] + vanishedError / connectedCount;
+        direction[i] = residual[i] / diagonal[i];
+        residualNorm += residual[i] * direction[i];
+        errorNorm += errors[i] * errors[i];
+    }
+
+    for (int iteration = 0; iteration < CAPACITY_CG_ITERATIONS && residualNorm > 0; ++iteration) {
+        ApplyCapacityJacobian(adjacencies, adjacenciesCount, regularization, direction, product);
+
+        double curvature = 0;
+        for (size_t i = 0; i < SEEDS_COUNT; ++i) {
+            curvature += direction[i] * product[i];
+        }
+
+        double alpha = residualNorm / curvature;
+        double nextResidualNorm = 0;
+        double squaredResidual = 0;
+        for (size_t i = 0; i < SEEDS_COUNT; ++i) {
+            step[i] += alpha * direction[i];
+            residual[i] -= alpha * product[i];
+            nextResidualNorm += residual[i] * residual[i] / diagonal[i];
+            squaredResidual += residual[i] * residual[i];
+        }
+        if (squaredResidual <= CAPACITY_CG_TOLERANCE * CAPACITY_CG_TOLERANCE * errorNorm) {
+            break;
+        }
+
+        for (size_t i = 0; i < SEEDS_COUNT; ++i) {
+            direction[i] = residual[i] / diagonal[i] + nextResidualNorm / residualNorm * direction[i];
+        }
+        residualNorm = nextResidualNorm;
+    }
+}
+
+/**
+ * @brief Partition the image into cells of equal capacity, the pixel count or
+ * the summed density, by adjusting power weights of the seeds. Every
+ * iteration renders the power diagram, which measures the capacities and
+ * their derivative, and takes a damped Newton step on the weights: the step
+ * is halved until it reduces the squared capacity error without shrinking
+ * any cell below half of the smallest capacity seen so far, until all cells
+ * are within CAPACITY_TOLERANCE of the target or no step helps anymore.
+ * Coincident seeds cannot be split by any weights, so the lowest of them
+ * takes the capacity of all and the others follow its weight. The final
+ * diagram is left in the label buffer.
+ * 
+ * @param density Density per pixel with a mean of 1, or NULL for uniform
+ * @return * Balance 
+ */
+void RenderVoronoiBalanced(const float *density) 
+{
+    Arena *arena = ThreadArena();
+    size_t mark = arena->used;
+    double *weights = ArenaAlloc(arena, SEEDS_COUNT * sizeof(double));
+    double *previousWeights = ArenaAlloc(arena, SEEDS_COUNT * sizeof(double));
+    double *capacities = ArenaAlloc(arena, SEEDS_COUNT * sizeof(double));
+    double *targets = ArenaAlloc(arena, SEEDS_COUNT * sizeof(double));
+    double *errors = ArenaAlloc(arena, SEEDS_COUNT * sizeof(double));
+    double *step = ArenaAlloc(arena, SEEDS_COUNT * sizeof(double));
+    double *scratch = ArenaAlloc(arena, 5 * SEEDS_COUNT * sizeof(double));
+    uint32_t *owners = ArenaAlloc(arena, SEEDS_COUNT * sizeof(uint32_t));
+    CellAdjacency *adjacencies = NULL;
+    size_t adjacenciesCapacity = 0;
+    double target = (double)WIDTH * HEIGHT / SEEDS_COUNT;
+    double stepLength = 1;
+    double previousError = INFINITY;
+    double maxError = INFINITY;
+    double minCapacity = INFINITY;
+    struct timespec begin, end;
+    SeedGrid grid;
+    int passes = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    BuildSeedGrid(&grid, seeds, SEEDS_COUNT, arena);
+    memset(weights, 0, SEEDS_COUNT * sizeof(double));
+    memset(targets, 0, SEEDS_COUNT * sizeof(double));
+
+    for (size_t i = 0; i < SEEDS_COUNT; ++i) {
+        owners[i] = NearestSeed(&grid, seeds[i].x, seeds[i].y);
+        targets[owners[i]] += target;
+    }
+
+    while (passes < CAPACITY_ITERATIONS) {
+        RenderPowerDiagram(&grid, weights, density, capacities);
+        ++passes;
+
+        double error = 0;
+        double stepMaxError = 0;
+        double stepMinCapacity = INFINITY;
+        for (size_t i = 0; i < SEEDS_COUNT; ++i) {
+            if (owners[i] == i) {
+                double cellError = (targets[i] - capacities[i]) / targets[i];
+                stepMaxError = fmax(stepMaxError, fabs(cellError));
+                stepMinCapacity = fmin(stepMinCapacity, capacities[i]);
+                error += cellError * cellError;
+            }
+        }
+
+        if (previousError < INFINITY && (error >= previousError || stepMinCapacity < 0.5 * minCapacity)) {
+            if (stepLength <= CAPACITY_MIN_STEP) {
+                break;
+            }
+            stepLength *= 0.5;
+        } else {
+            previousError = error;
+            maxError = stepMaxError;
+            minCapacity = fmin(minCapacity, stepMinCapacity);
+            stepLength = fmin(stepLength * 2, 1);
+            memcpy(previousWeights, weights, SEEDS_COUNT * sizeof(double));
+            if (maxError <= CAPACITY_TOLERANCE) {
+                break;
+            }
+
+            for (size_t i = 0; i < SEEDS_COUNT; ++i) {
+                errors[i] = targets[i] - capacities[i];
+            }
+            size_t adjacenciesCount = MeasureCellAdjacencies(density, &adjacencies, &adjacenciesCapacity);
+            SolveCapacityStep(adjacencies, adjacenciesCount, errors, step, scratch);
+        }
+
+        double meanWeight = 0;
+        for (size_t i = 0; i < SEEDS_COUNT; ++i) {
+            weights[i] = previousWeights[i] + stepLength * step[i];
+            meanWeight += weights[i] / SEEDS_COUNT;
+        }
+        for (size_t i = 0; i < SEEDS_COUNT; ++i) {
+            weights[i] = owners[i] == i ? weights[i] - meanWeight : weights[owners[i]];
+        }
+    }
+
+    if (maxError > CAPACITY_TOLERANCE) {
+        RenderPowerDiagram(&grid, previousWeights, density, capacities);
+        ++passes;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    fprintf(stderr, "balanced: %d passes in %.1f ms, largest capacity error %.2f%%, rms %.2f%%\n", passes,
+            ((end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) * 1e-9) * 1e3, maxError * 100,
+            sqrt(previousError / SEEDS_COUNT) * 100);
+    free(adjacencies);
+    ArenaRewind(arena, mark);
+}
+
+/**
+ * @brief Clip a convex polygon against the half-plane of points closer to site
+ * than to other
+ * 
+ * @param polygon 
+ * @param count 
+ * @param clipped 
+ * @param site 
+ * @param other 
+ * @return size_t 
+ */
+size_t ClipPolygon(const Vec2d *polygon, size_t count, Vec2d *clipped, Vec2 site, Vec2 other) 
+{
+    double dx = other.x - site.x;
+    double dy = other.y - site.y;
+    double mx = (other.x + site.x) * 0.5;
+    double my = (other.y + site.y) * 0.5;
+    size_t clippedCount = 0;
+
+    for (size_t i = 0; i < count; ++i) {
+        Vec2d a = polygon[i];
+        Vec2d b = polygon[(i + 1) % count];
+        double sideA = (a.x - mx) * dx + (a.y - my) * dy;
+        double sideB = (b.x - mx) * dx + (b.y - my) * dy;
+
+        if (sideA <= 0) {
+            clipped[clippedCount++] = a;
+        }
+        if ((sideA < 0 && sideB > 0) || (sideA > 0 && sideB < 0)) {
+            double t = sideA / (sideA - sideB);
+            Vec2d crossing = {a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t};
+            clipped[clippedCount++] = crossing;
+        }
+        assert(clippedCount < POLYGON_MAX_VERTICES);
+    }
+
+    return clippedCount;
+}
+
+/**
+ * @brief Fill the Voronoi cell of a seed into the label buffer, one scanline
+ * at a time. The polygon only comes out of floating-point clipping, so a
+ * pixel is written straight away when it lies clearly inside it, farther than
+ * POLYGON_TOLERANCE from every edge. Pixels closer to an edge, which may sit
+ * exactly on a bisector, are resolved by NearestSeed and only written when
+ * this seed wins, so every pixel gets the same single owner as in the exact
+ * engine, ties going to the lower index.
+ * 
+ * @param grid 
+ * @param polygon 
+ * @param count 
+ * @param seedIdx 
+ * @return * Fill 
+ */
+void FillPolygonLabel(const SeedGrid *grid, const Vec2d *polygon, size_t count, uint32_t seedIdx) 
+{
+    Vec2d normals[POLYGON_MAX_VERTICES];
+    double margins[POLYGON_MAX_VERTICES];
+    double minY = polygon[0].y, maxY = polygon[0].y;
+    double centreX = 0, centreY = 0;
+
+    for (size_t i = 0; i < count; ++i) {
+        minY = polygon[i].y < minY ? polygon[i].y : minY;
+        maxY = polygon[i].y > maxY ? polygon[i].y : maxY;
+        centreX += polygon[i].x / count;
+        centreY += polygon[i].y / count;
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        Vec2d a = polygon[i];
+        Vec2d b = polygon[(i + 1) % count];
+        Vec2d normal = {a.y - b.y, b.x - a.x};
+
+        if (normal.x * (centreX - a.x) + normal.y * (centreY - a.y) < 0) {
+            normal.x = -normal.x;
+            normal.y = -normal.y;
+        }
+        normals[i] = normal;
+        margins[i] = POLYGON_TOLERANCE * hypot(normal.x, normal.y);
+    }
+
+    int beginY = (int)ceil(minY - POLYGON_TOLERANCE);
+    int endY = (int)floor(maxY + POLYGON_TOLERANCE);
+    beginY = beginY < 0 ? 0 : beginY;
+    endY = endY < HEIGHT ? endY : HEIGHT - 1;
+
+    for (int y = beginY; y <= endY; ++y) {
+        double left = INFINITY, right = -INFINITY;
+        double safeLeft = -INFINITY, safeRight = INFINITY;
+
+        for (size_t i = 0; i < count; ++i) {
+            Vec2d a = polygon[i];
+            Vec2d b = polygon[(i + 1) % count];
+
+            if (a.y != b.y && ((a.y <= y && y <= b.y) || (b.y <= y && y <= a.y))) {
+                double x = a.x + (b.x - a.x) * (y - a.y) / (b.y - a.y);
+                left = x < left ? x : left;
+                right = x > right ? x : right;
+            }
+            if (fabs(a.y - y) <= POLYGON_TOLERANCE) {
+                left = a.x < left ? a.x : left;
+                right = a.x > right ? a.x : right;
+            }
+            if (margins[i] == 0) {
+                continue;
+            }
+
+            double margin = margins[i] - normals[i].y * (y - a.y);
+            if (normals[i].x > 0) {
+                safeLeft = fmax(safeLeft, a.x + margin / normals[i].x);
+            } else if (normals[i].x < 0) {
+                safeRight = fmin(safeRight, a.x + margin / normals[i].x);
+            } else if (margin >= 0) {
+                safeRight = -INFINITY;
+            }
+        }
+        if (left > right) {
+            continue;
+        }
+
+        int beginX = (int)ceil(left - POLYGON_TOLERANCE);
+        int endX = (int)floor(right + POLYGON_TOLERANCE);
+        beginX = beginX < 0 ? 0 : beginX;
+        endX = endX < WIDTH ? endX : WIDTH - 1;
+
+        for (int x = beginX; x <= endX; ++x) {
+            if ((x > safeLeft && x < safeRight) || NearestSeed(grid, x, y) == seedIdx) {
+                labels[y][x] = seedIdx;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Build the Voronoi cell of a seed by clipping the image rectangle
+ * against the bisectors of its neighbours. Neighbours are visited in rings of
+ * grid cells until no seed left can be closer than twice the cell's radius.
+ * A seed sharing its position with a lower index gets an empty cell.
+ * 
+ * @param grid 
+ * @param seedIdx 
+ * @param polygon 
+ * @return size_t 
+ */
+size_t BuildCellPolygon(const SeedGrid *grid, uint32_t seedIdx, Vec2d *polygon) 
+{
+    Vec2d buffer[POLYGON_MAX_VERTICES];
+    Vec2 site = grid->points[seedIdx];
+    size_t count = 4;
+
+    polygon[0] = (Vec2d){-0.5, -0.5};
+    polygon[1] = (Vec2d){WIDTH - 0.5, -0.5};
+    polygon[2] = (Vec2d){WIDTH - 0.5, HEIGHT - 0.5};
+    polygon[3] = (Vec2d){-0.5, HEIGHT - 0.5};
+
+    int siteCol = (site.x - grid->originX) / grid->cellSize;
+    int siteRow = (site.y - grid->originY) / grid->cellSize;
+
+    for (int ring = 0; count > 0; ++ring) {
+        int beginCol = siteCol - ring, endCol = siteCol + ring;
+        int beginRow = siteRow - ring, endRow = siteRow + ring;
+
+        if (beginCol < -1 && beginRow < -1 && endCol > grid->cols && endRow > grid->rows) {
+            break;
+        }
+
+        double radius = 0;
+        for (size_t i = 0; i < count; ++i) {
+            double dx = polygon[i].x - site.x;
+            double dy = polygon[i].y - site.y;
+            radius = dx * dx + dy * dy > radius ? dx * dx + dy * dy : radius;
+        }
+
+        double reach = (double)(ring - 1) * grid->cellSize;
+        if (ring > 0 && reach * reach > 4 * radius) {
+            break;
+        }
+
+        for (int row = beginRow; row <= endRow; ++row) {
+            if (row < 0 || row >= grid->rows) {
+                continue;
+            }
+            int step = (row == beginRow || row == endRow) ? 1 : endCol - beginCol;
+
+            for (int col = beginCol; col <= endCol; col += step > 0 ? step : 1) {
+                if (col < 0 || col >= grid->cols) {
+                    continue;
+                }
+                size_t cell = (size_t)row * grid->cols + col;
+
+                for (uint32_t i = grid->cellStart[cell]; i < grid->cellStart[cell + 1]; ++i) {
+                    Vec2 other = grid->points[grid->cellSeeds[i]];
+
+                    if (other.x == site.x && other.y == site.y) {
+                        if (grid->cellSeeds[i] < seedIdx) {
+                            return 0;
+                        }
+                        continue;
+                    }
+                    count = ClipPolygon(polygon, count, buffer, site, other);
+                    memcpy(polygon, buffer, count * sizeof(Vec2d));
+                }
+            }
+        }
+    }
+
+    return count;
+}
+
+/**
+ * @brief Render the Voronoi cells into the label buffer as polygons, one
+ * independent cell per seed
+ * 
+ * @return * Render 
+ */
+void RenderVoronoiPolygons() 
+{
+    Arena *arena = ThreadArena();
+    size_t mark = arena->used;
+    SeedGrid grid;
+
+    BuildSeedGrid(&grid, seeds, SEEDS_COUNT, arena);
+
+    #pragma omp parallel for schedule(dynamic, 16)
+    for (size_t i = 0; i < SEEDS_COUNT; ++i) {
+        Vec2d polygon[POLYGON_MAX_VERTICES];
+        size_t count = BuildCellPolygon(&grid, i, polygon);
+
+        if (count > 0) {
+            FillPolygonLabel(&grid, polygon, count, i);
+        }
+    }
+
+    ArenaRewind(arena, mark);
+}
+
+/**
+ * @brief Get the label of a pixel, LABEL_NONE outside the image
+ * 
+ * @param x 
+ * @param y 
+ * @return uint32_t 
+ */
+uint32_t LabelAt(int x, int y) 
+{
+    if (x < 0 || y < 0 || x >= WIDTH || y >= HEIGHT) {
+        return LABEL_NONE;
+    }
+    return labels[y][x];
+}
+
+/**
+ * @brief Check whether three or more labels meet at a pixel corner. Shared
+ * boundaries are simplified between such corners, so both cells on either
+ * side of a boundary end up with the same polyline.
+ * 
+ * @param x 
+ * @param y 
+ * @return int 
+ */
+int IsJunction(int x, int y) 
+{
+    uint32_t around[4] = {LabelAt(x - 1, y - 1), LabelAt(x, y - 1), LabelAt(x, y), LabelAt(x - 1, y)};
+    int distinct = 0;
+
+    for (int i = 0; i < 4; ++i) {
+        int seen = 0;
+        for (int j = 0; j < i; ++j) {
+            seen |= around[j] == around[i];
+        }
+        distinct += !seen;
+    }
+    return distinct >= 3;
+}
+
+void PushOutlinePoint(Outline *outline, Vec2 point, uint8_t anchor) 
+{
+    if (outline->count == outline->capacity) {
+        outline->capacity = outline->capacity > 0 ? 2 * outline->capacity : 64;
+        outline->points = realloc(outline->points, outline->capacity * sizeof(Vec2));
+        outline->anchors = realloc(outline->anchors, outline->capacity * sizeof(uint8_t));
+        assert(outline->points != NULL && outline->anchors != NULL);
+    }
+    outline->points[outline->count] = point;
+    outline->anchors[outline->count++] = anchor;
+}
+
+void EndOutlineLoop(Outline *outline) 
+{
+    if (outline->loopsCount == outline->loopsCapacity) {
+        outline->loopsCapacity = outline->loopsCapacity > 0 ? 2 * outline->loopsCapacity : 4;
+        outline->loopEnds = realloc(outline->loopEnds, outline->loopsCapacity * sizeof(uint32_t));
+        assert(outline->loopEnds != NULL);
+    }
+    outline->loopEnds[outline->loopsCount++] = outline->count;
+}
+
+void FreeOutline(Outline *outline) 
+{
+    free(outline->points);
+    free(outline->anchors);
+    free(outline->loopEnds);
+    memset(outline, 0, sizeof(*outline));
+}
+
+/**
+ * @brief Follow the pixel cracks around a 4-connected region of a label,
+ * keeping the region on the right, marching-squares style: at every corner
+ * the two pixels ahead decide between turning right, left or going straight.
+ * Only corners that turn or are junctions are kept.
+ * 
+ * @param outline 
+ * @param label 
+ * @param startX 
+ * @param startY 
+ * @return int64_t Signed pixel area enclosed by the loop
+ */
+int64_t TraceOutlineLoop(Outline *outline, uint32_t label, int startX, int startY) 
+{
+    static const int stepX[4] = {1, 0, -1, 0};
+    static const int stepY[4] = {0, 1, 0, -1};
+    static const int rightX[4] = {0, -1, -1, 0};
+    static const int rightY[4] = {0, 0, -1, -1};
+    int x = startX, y = startY, direction = 0;
+
+    PushOutlinePoint(outline, (Vec2){x, y}, IsJunction(x, y));
+    do {
+        if (direction == 0) {
+            traced[y][x] = 1;
+        }
+        x += stepX[direction];
+        y += stepY[direction];
+
+        int right = (direction + 1) % 4, left = (direction + 3) % 4;
+        int turn = direction;
+        if (LabelAt(x + rightX[direction], y + rightY[direction]) != label) {
+            turn = right;
+        } else if (LabelAt(x + rightX[left], y + rightY[left]) == label) {
+            turn = left;
+        }
+
+        int junction = IsJunction(x, y);
+        if ((turn != direction || junction) && !(x == startX && y == startY)) {
+            PushOutlinePoint(outline, (Vec2){x, y}, junction);
+        }
+        direction = turn;
+    } while (!(x == startX && y == startY && direction == 0));
+
+    int64_t area = 0;
+    for (size_t i = 0; i < outline->count; ++i) {
+        Vec2 a = outline->points[i], b = outline->points[(i + 1) % outline->count];
+        area += (int64_t)a.x * b.y - (int64_t)b.x * a.y;
+    }
+    return area / 2;
+}
+
+int CompareVec2(Vec2 a, Vec2 b) 
+{
+    return a.y != b.y ? (a.y > b.y) - (a.y < b.y) : (a.x > b.x) - (a.x < b.x);
+}
+
+/**
+ * @brief Mark the points of a polyline kept by Douglas-Peucker. The polyline
+ * is always walked from its smaller end so that a boundary simplifies the same
+ * way from both of its cells.
+ * 
+ * @param points 
+ * @param count 
+ * @param keep 
+ * @return * Simplify 
+ */
+void SimplifyPolyline(const Vec2 *points, size_t count, uint8_t *keep) 
+{
+    int reversed = CompareVec2(points[0], points[count - 1]) > 0;
+    size_t stack[2 * 64];
+    size_t depth = 0;
+
+    #define POLYLINE_AT(i) points[reversed ? count - 1 - (i) : (i)]
+
+    memset(keep, 0, count);
+    keep[0] = keep[count - 1] = 1;
+    stack[depth++] = 0;
+    stack[depth++] = count - 1;
+
+    while (depth > 0) {
+        size_t last = stack[--depth];
+        size_t first = stack[--depth];
+        Vec2 a = POLYLINE_AT(first), b = POLYLINE_AT(last);
+        double dx = b.x - a.x, dy = b.y - a.y;
+        double length = sqrt(dx * dx + dy * dy);
+        double farthest = OUTLINE_TOLERANCE;
+        size_t farthestIdx = 0;
+
+        for (size_t i = first + 1; i < last; ++i) {
+            Vec2 p = POLYLINE_AT(i);
+            double distance = length > 0
+                ? fabs(dx * (p.y - a.y) - dy * (p.x - a.x)) / length
+                : hypot(p.x - a.x, p.y - a.y);
+
+            if (distance > farthest) {
+                farthest = distance;
+                farthestIdx = i;
+            }
+        }
+
+        if (farthestIdx > 0) {
+            keep[reversed ? count - 1 - farthestIdx : farthestIdx] = 1;
+            if (depth + 4 <= sizeof(stack) / sizeof(stack[0])) {
+                stack[depth++] = first;
+                stack[depth++] = farthestIdx;
+                stack[depth++] = farthestIdx;
+                stack[depth++] = last;
+            } else {
+                for (size_t i = first + 1; i < last; ++i) {
+                    keep[reversed ? count - 1 - i : i] = 1;
+                }
+            }
+        }
+    }
+
+    #undef POLYLINE_AT
+}
+
+/**
+ * @brief Simplify one traced loop between its junctions and append it to the
+ * result. A loop without junctions is split at its farthest point instead.
+ * 
+ * @param raw 
+ * @param result 
+ * @return * Simplify 
+ */
+void SimplifyOutlineLoop(Outline *raw, Outline *result) 
+{
+    size_t count = raw->count;
+    size_t firstAnchor = count;
+
+    for (size_t i = 0; i < count && firstAnchor == count; ++i) {
+        if (raw->anchors[i]) {
+            firstAnchor = i;
+        }
+    }
+    if (firstAnchor == count) {
+        size_t farthestIdx = 0;
+        for (size_t i = 1; i < count; ++i) {
+            if (SquareDistance(raw->points[i], raw->points[0]) > SquareDistance(raw->points[farthestIdx], raw->points[0])) {
+                farthestIdx = i;
+            }
+        }
+        raw->anchors[0] = raw->anchors[farthestIdx] = 1;
+        firstAnchor = 0;
+    }
+
+    Vec2 *segment = malloc((count + 1) * sizeof(Vec2));
+    uint8_t *keep = malloc(count + 1);
+    assert(segment != NULL && keep != NULL);
+
+    size_t begin = firstAnchor;
+    do {
+        size_t length = 0;
+        size_t i = begin;
+        do {
+            segment[length++] = raw->points[i];
+            i = (i + 1) % count;
+        } while (!raw->anchors[i] && i != begin);
+        segment[length++] = raw->points[i];
+
+        SimplifyPolyline(segment, length, keep);
+        for (size_t k = 0; k + 1 < length; ++k) {
+            if (keep[k]) {
+                PushOutlinePoint(result, segment[k], k == 0);
+            }
+        }
+        begin = i;
+    } while (begin != firstAnchor);
+
+    EndOutlineLoop(result);
+    free(segment);
+    free(keep);
+}
+
+/**
+ * @brief Trace every loop of a cell. The loop through the cell's first pixel
+ * usually encloses all of it; only when its area falls short of the pixel
+ * count is the bounding box scanned for more loops, each found from a pixel
+ * whose top edge is on the boundary and not traced yet.
+ * 
+ * @param label 
+ * @param bounds 
+ * @param result 
+ * @return * Trace 
+ */
+void TraceCellOutline(uint32_t label, const CellBounds *bounds, Outline *result) 
+{
+    Outline raw = {0};
+    int64_t area = TraceOutlineLoop(&raw, label, bounds->startX, bounds->minY);
+
+    SimplifyOutlineLoop(&raw, result);
+    if (area != bounds->area) {
+        for (int y = bounds->minY; y <= bounds->maxY; ++y) {
+            for (int x = bounds->minX; x <= bounds->maxX; ++x) {
+                if (labels[y][x] == label && LabelAt(x, y - 1) != label && !traced[y][x]) {
+                    raw.count = 0;
+                    TraceOutlineLoop(&raw, label, x, y);
+                    SimplifyOutlineLoop(&raw, result);
+                }
+            }
+        }
+    }
+    FreeOutline(&raw);
+}
+
+/**
+ * @brief Write the simplified outline of every cell in the label buffer,
+ * as an SVG when the path ends in .svg and as binary polylines otherwise.
+ * Cells are traced in parallel in batches, in the raster order of their
+ * first pixels so that neighbouring cells share cache lines, and each batch
+ * is streamed out in that order.
+ * 
+ * @param points 
+ * @param filePath 
+ * @return * Save 
+ */
+void SaveOutlines(const Vec2 *points, const char *filePath) 
+{
+    FILE *file = fopen(filePath, "wb");
+
+    if (file == NULL) {
+        fprintf(stderr, "ERROR: cannot write into file %s: %s\n", filePath, strerror(errno));
+        exit(1);
+    }
+
+    size_t pathLength = strlen(filePath);
+    int svg = pathLength >= 4 && strcmp(filePath + pathLength - 4, ".svg") == 0;
+    uint32_t size[2] = {WIDTH, HEIGHT};
+
+    if (svg) {
+        fprintf(file, "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"%d\" height=\"%d\" viewBox=\"0 0 %d %d\">\n",
+                WIDTH, HEIGHT, WIDTH, HEIGHT);
+    } else {
+        fwrite(OUTLINE_MAGIC, 8, 1, file);
+        fwrite(size, sizeof(size), 1, file);
+    }
+
+    CellBounds *cells = malloc(SEEDS_COUNT * sizeof(CellBounds));
+    uint32_t *order = malloc(SEEDS_COUNT * sizeof(uint32_t));
+    Outline *outlines = calloc(OUTLINE_BATCH_CELLS, sizeof(Outline));
+    size_t cellsCount = 0;
+    assert(cells != NULL && order != NULL && outlines != NULL);
+
+    for (size_t i = 0; i < SEEDS_COUNT; ++i) {
+        cells[i] = (CellBounds){INT32_MAX, -1, -1, -1, -1, 0};
+    }
+    for (int y = 0; y < HEIGHT; ++y) {
+        for (int x = 0; x < WIDTH; ++x) {
+            uint32_t label = labels[y][x];
+            if (label == LABEL_NONE) {
+                continue;
+            }
+
+            CellBounds *cell = &cells[label];
+            if (cell->area++ == 0) {
+                order[cellsCount++] = label;
+                cell->minY = y;
+                cell->startX = x;
+            }
+            cell->minX = x < cell->minX ? x : cell->minX;
+            cell->maxX = x > cell->maxX ? x : cell->maxX;
+            cell->maxY = y;
+        }
+    }
+    memset(traced, 0, sizeof(traced));
+
+    for (size_t batch = 0; batch < cellsCount; batch += OUTLINE_BATCH_CELLS) {
+        size_t batchCount = cellsCount - batch < OUTLINE_BATCH_CELLS ? cellsCount - batch : OUTLINE_BATCH_CELLS;
+
+        #pragma omp parallel for schedule(dynamic, 16)
+        for (size_t i = 0; i < batchCount; ++i) {
+            TraceCellOutline(order[batch + i], &cells[order[batch + i]], &outlines[i]);
+        }
+
+        for (size_t i = 0; i < batchCount; ++i) {
+            uint32_t label = order[batch + i];
+            Outline *outline = &outlines[i];
+
+            for (size_t loop = 0, first = 0; loop < outline->loopsCount; first = outline->loopEnds[loop++]) {
+                uint32_t count = outline->loopEnds[loop] - first;
+
+                if (svg) {
+                    Color color = SeedToColor(points[label]);
+                    fprintf(file, "<path fill=\"#%02x%02x%02x\" d=\"M",
+                            color & 0xFF, (color >> 8) & 0xFF, (color >> 16) & 0xFF);
+                    for (size_t k = first; k < first + count; ++k) {
+                        fprintf(file, " %d %d", outline->points[k].x, outline->points[k].y);
+                    }
+                    fprintf(file, "Z\"/>\n");
+                } else {
+                    fwrite(&label, sizeof(label), 1, file);
+                    fwrite(&count, sizeof(count), 1, file);
+                    fwrite(&outline->points[first], sizeof(Vec2), count, file);
+                }
+            }
+            FreeOutline(outline);
+        }
+        assert(!ferror(file));
+    }
+
+    if (svg) {
+        fprintf(file, "</svg>\n");
+    }
+
+    free(cells);
+    free(order);
+    free(outlines);
+    int err = fclose(file);
+    assert(err == 0);
+}
+
+/**
+ * @brief Get twice the signed area of a triangle, positive when counter-clockwise
+ * 
+ * @param a 
+ * @param b 
+ * @param c 
+ * @return int64_t 
+ */
+int64_t Orient(Vec2 a, Vec2 b, Vec2 c) 
+{
+    return (int64_t)(b.x - a.x) * (c.y - a.y) - (int64_t)(b.y - a.y) * (c.x - a.x);
+}
+
+/**
+ * @brief Test a point against the circumcircle of a counter-clockwise
+ * triangle: positive inside, negative outside, zero on the circle. Exact as
+ * long as coordinates stay within the super triangle.
+ * 
+ * @param a 
+ * @param b 
+ * @param c 
+ * @param d 
+ * @return int64_t 
+ */
+int64_t InCircle(Vec2 a, Vec2 b, Vec2 c, Vec2 d) 
+{
+    int64_t adx = a.x - d.x, ady = a.y - d.y;
+    int64_t bdx = b.x - d.x, bdy = b.y - d.y;
+    int64_t cdx = c.x - d.x, cdy = c.y - d.y;
+
+    return (adx * adx + ady * ady) * (bdx * cdy - cdx * bdy)
+         + (bdx * bdx + bdy * bdy) * (cdx * ady - adx * cdy)
+         + (cdx * cdx + cdy * cdy) * (adx * bdy - bdx * ady);
+}
+
+Vec2 DelaunayPoint(const Delaunay *dt, uint32_t vertex) 
+{
+    if (vertex >= DELAUNAY_SUPER_VERTEX) {
+        return dt->superVertices[vertex - DELAUNAY_SUPER_VERTEX];
+    }
+    return dt->points[vertex];
+}
+
+/**
+ * @brief Create an empty triangulation over a caller-owned points array. Only
+ * the super triangle enclosing the image exists until vertices are inserted.
+ * Vertices sharing a position are kept in a chain sorted by index, only the
+ * lowest index, which owns the pixels, sits in the triangulation.
+ * 
+ * @param dt 
+ * @param points 
+ * @param capacity 
+ * @return * Init 
+ */
+void InitDelaunay(Delaunay *dt, Vec2 *points, size_t capacity) 
+{
+    assert(WIDTH <= DELAUNAY_SUPER_RADIUS && HEIGHT <= DELAUNAY_SUPER_RADIUS);
+
+    int cx = WIDTH / 2, cy = HEIGHT / 2, r = DELAUNAY_SUPER_RADIUS;
+
+    dt->points = points;
+    dt->capacity = capacity;
+    dt->superVertices[0] = (Vec2){cx - 2 * r, cy - r};
+    dt->superVertices[1] = (Vec2){cx + 2 * r, cy - r};
+    dt->superVertices[2] = (Vec2){cx, cy + 2 * r};
+
+    dt->trianglesCapacity = 2 * capacity + 16;
+    dt->vertexTriangles = malloc(capacity * sizeof(int32_t));
+    dt->coincident = malloc(capacity * sizeof(uint32_t));
+    dt->triangles = malloc(dt->trianglesCapacity * sizeof(Triangle));
+    dt->freeTriangles = malloc(dt->trianglesCapacity * sizeof(int32_t));
+    dt->affectedFlags = calloc(capacity, sizeof(uint8_t));
+    dt->affected = malloc(capacity * sizeof(uint32_t));
+    assert(dt->vertexTriangles != NULL && dt->triangles != NULL && dt->freeTriangles != NULL);
+    assert(dt->coincident != NULL && dt->affectedFlags != NULL && dt->affected != NULL);
+
+    for (size_t i = 0; i < capacity; ++i) {
+        dt->vertexTriangles[i] = -1;
+        dt->coincident[i] = LABEL_NONE;
+    }
+
+    Triangle super = {
+        {DELAUNAY_SUPER_VERTEX, DELAUNAY_SUPER_VERTEX + 1, DELAUNAY_SUPER_VERTEX + 2},
+        {-1, -1, -1}
+    };
+    dt->triangles[0] = super;
+    dt->trianglesCount = 1;
+    dt->freeCount = 0;
+    dt->lastTriangle = 0;
+    dt->affectedCount = 0;
+    dt->dirtyMinX = dt->dirtyMinY = INT32_MAX;
+    dt->dirtyMaxX = dt->dirtyMaxY = INT32_MIN;
+}
+
+/**
+ * @brief Release the triangulation, the points array is left alone
+ * 
+ * @param dt 
+ * @return * Free 
+ */
+void FreeDelaunay(Delaunay *dt) 
+{
+    free(dt->vertexTriangles);
+    free(dt->coincident);
+    free(dt->triangles);
+    free(dt->freeTriangles);
+    free(dt->affectedFlags);
+    free(dt->affected);
+}
+
+int32_t AllocTriangle(Delaunay *dt) 
+{
+    if (dt->freeCount > 0) {
+        return dt->freeTriangles[--dt->freeCount];
+    }
+    if (dt->trianglesCount == dt->trianglesCapacity) {
+        dt->trianglesCapacity *= 2;
+        dt->triangles = realloc(dt->triangles, dt->trianglesCapacity * sizeof(Triangle));
+        dt->freeTriangles = realloc(dt->freeTriangles, dt->trianglesCapacity * sizeof(int32_t));
+        assert(dt->triangles != NULL && dt->freeTriangles != NULL);
+    }
+    return dt->trianglesCount++;
+}
+
+/**
+ * @brief Record the vertices of a created or destroyed triangle as affected
+ * and grow the dirty rectangle by the part of its circumcircle inside the
+ * image, which bounds every pixel whose closest seed may have changed
+ * 
+ * @param dt 
+ * @param triangle 
+ * @return * Mark 
+ */
+void MarkAffectedTriangle(Delaunay *dt, int32_t triangle) 
+{
+    const uint32_t *vertices = dt->triangles[triangle].vertices;
+
+    for (int i = 0; i < 3; ++i) {
+        if (vertices[i] < DELAUNAY_SUPER_VERTEX && !dt->affectedFlags[vertices[i]]) {
+            dt->affectedFlags[vertices[i]] = DELAUNAY_AFFECTED;
+            dt->affected[dt->affectedCount++] = vertices[i];
+        }
+    }
+
+    Vec2 a = DelaunayPoint(dt, vertices[0]);
+    Vec2 b = DelaunayPoint(dt, vertices[1]);
+    Vec2 c = DelaunayPoint(dt, vertices[2]);
+    double bx = b.x - a.x, by = b.y - a.y;
+    double cx = c.x - a.x, cy = c.y - a.y;
+    double d = 2 * (bx * cy - by * cx);
+    double ux = a.x + (cy * (bx * bx + by * by) - by * (cx * cx + cy * cy)) / d;
+    double uy = a.y + (bx * (cx * cx + cy * cy) - cx * (bx * bx + by * by)) / d;
+    double radius = sqrt((ux - a.x) * (ux - a.x) + (uy - a.y) * (uy - a.y)) + 1;
+
+    double nearestX = fmin(fmax(ux, 0), WIDTH - 1);
+    double nearestY = fmin(fmax(uy, 0), HEIGHT - 1);
+    double spanX = radius * radius - (nearestY - uy) * (nearestY - uy);
+    double spanY = radius * radius - (nearestX - ux) * (nearestX - ux);
+    if (spanX < 0 || spanY < 0) {
+        return;
+    }
+
+    int minX = (int)floor(fmax(ux - sqrt(spanX), 0));
+    int minY = (int)floor(fmax(uy - sqrt(spanY), 0));
+    int maxX = (int)ceil(fmin(ux + sqrt(spanX), WIDTH - 1));
+    int maxY = (int)ceil(fmin(uy + sqrt(spanY), HEIGHT - 1));
+    dt->dirtyMinX = minX < dt->dirtyMinX ? minX : dt->dirtyMinX;
+    dt->dirtyMinY = minY < dt->dirtyMinY ? minY : dt->dirtyMinY;
+    dt->dirtyMaxX = maxX > dt->dirtyMaxX ? maxX : dt->dirtyMaxX;
+    dt->dirtyMaxY = maxY > dt->dirtyMaxY ? maxY : dt->dirtyMaxY;
+}
+
+/**
+ * @brief Forget the changes accumulated since the last repaint
+ * 
+ * @param dt 
+ * @return * Clear 
+ */
+void ClearDelaunayChanges(Delaunay *dt) 
+{
+    for (size_t i = 0; i < dt->affectedCount; ++i) {
+        dt->affectedFlags[dt->affected[i]] = 0;
+    }
+    dt->affectedCount = 0;
+    dt->dirtyMinX = dt->dirtyMinY = INT32_MAX;
+    dt->dirtyMaxX = dt->dirtyMaxY = INT32_MIN;
+}
+
+/**
+ * @brief Walk from the last touched triangle towards a point until reaching
+ * the triangle that contains it
+ * 
+ * @param dt 
+ * @param point 
+ * @return int32_t 
+ */
+int32_t LocateTriangle(const Delaunay *dt, Vec2 point) 
+{
+    int32_t triangle = dt->lastTriangle;
+
+    for (int steps = 0; ; ++steps) {
+        const Triangle *t = &dt->triangles[triangle];
+        int moved = 0;
+
+        for (int k = 0; k < 3; ++k) {
+            int i = (k + steps) % 3;
+            Vec2 a = DelaunayPoint(dt, t->vertices[(i + 1) % 3]);
+            Vec2 b = DelaunayPoint(dt, t->vertices[(i + 2) % 3]);
+
+            if (Orient(a, b, point) < 0) {
+                assert(t->neighbours[i] >= 0);
+                triangle = t->neighbours[i];
+                moved = 1;
+                break;
+            }
+        }
+        if (!moved) {
+            return triangle;
+        }
+    }
+}
+
+/**
+ * @brief Connect freshly created triangles to each other and to the triangles
+ * outside the boundary of the region they fill
+ * 
+ * @param dt 
+ * @param created 
+ * @param createdCount 
+ * @param boundary 
+ * @param boundaryCount 
+ * @return * Link 
+ */
+void LinkTriangles(Delaunay *dt, const int32_t *created, size_t createdCount,
+                   const BoundaryEdge *boundary, size_t boundaryCount) 
+{
+    for (size_t n = 0; n < createdCount; ++n) {
+        Triangle *t = &dt->triangles[created[n]];
+
+        for (int i = 0; i < 3; ++i) {
+            uint32_t from = t->vertices[(i + 1) % 3];
+            uint32_t to = t->vertices[(i + 2) % 3];
+            int linked = 0;
+
+            for (size_t e = 0; e < boundaryCount && !linked; ++e) {
+                if (boundary[e].from != from || boundary[e].to != to) {
+                    continue;
+                }
+                t->neighbours[i] = boundary[e].outside;
+                if (boundary[e].outside >= 0) {
+                    Triangle *outside = &dt->triangles[boundary[e].outside];
+                    for (int j = 0; j < 3; ++j) {
+                        if (outside->vertices[(j + 1) % 3] == to && outside->vertices[(j + 2) % 3] == from) {
+                            outside->neighbours[j] = created[n];
+                        }
+                    }
+                }
+                linked = 1;
+            }
+            for (size_t m = 0; m < createdCount && !linked; ++m) {
+                const Triangle *other = &dt->triangles[created[m]];
+                for (int j = 0; j < 3; ++j) {
+                    if (other->vertices[(j + 1) % 3] == to && other->vertices[(j + 2) % 3] == from) {
+                        t->neighbours[i] = created[m];
+                        linked = 1;
+                    }
+                }
+            }
+            assert(linked);
+
+            if (t->vertices[i] < DELAUNAY_SUPER_VERTEX) {
+                dt->vertexTriangles[t->vertices[i]] = created[n];
+            }
+        }
+        MarkAffectedTriangle(dt, created[n]);
+    }
+
+    dt->lastTriangle = created[0];
+}
+
+/**
+ * @brief Put another vertex in place of a triangulated one at the same
+ * position, marking its star as affected
+ * 
+ * @param dt 
+ * @param vertex 
+ * @param replacement 
+ * @return * Put 
+ */
+void ReplaceDelaunayVertex(Delaunay *dt, uint32_t vertex, uint32_t replacement) 
+{
+    int32_t first = dt->vertexTriangles[vertex];
+    int32_t triangle = first;
+
+    do {
+        Triangle *t = &dt->triangles[triangle];
+        int i = t->vertices[0] == vertex ? 0 : t->vertices[1] == vertex ? 1 : 2;
+
+        t->vertices[i] = replacement;
+        MarkAffectedTriangle(dt, triangle);
+        triangle = t->neighbours[(i + 1) % 3];
+    } while (triangle != first);
+
+    dt->vertexTriangles[replacement] = first;
+    dt->vertexTriangles[vertex] = -1;
+}
+
+/**
+ * @brief Find the triangulated vertex at a position, LABEL_NONE when the
+ * position is free
+ * 
+ * @param dt 
+ * @param triangle Triangle containing the position
+ * @param point 
+ * @return uint32_t 
+ */
+uint32_t VertexAt(const Delaunay *dt, int32_t triangle, Vec2 point) 
+{
+    const uint32_t *vertices = dt->triangles[triangle].vertices;
+
+    for (int i = 0; i < 3; ++i) {
+        Vec2 corner = DelaunayPoint(dt, vertices[i]);
+        if (corner.x == point.x && corner.y == point.y) {
+            return vertices[i];
+        }
+    }
+    return LABEL_NONE;
+}
+
+/**
+ * @brief Insert a vertex by carving out every triangle whose circumcircle
+ * contains it and fanning the cavity around it. A vertex on top of an
+ * existing one joins its chain, and takes its place in the triangulation
+ * when its index is lower.
+ * 
+ * @param dt 
+ * @param vertex 
+ * @return * Insert 
+ */
+void DelaunayInsert(Delaunay *dt, uint32_t vertex) 
+{
+    Vec2 point = dt->points[vertex];
+    int32_t cavity[DELAUNAY_MAX_CAVITY];
+    BoundaryEdge boundary[DELAUNAY_MAX_CAVITY];
+    int32_t created[DELAUNAY_MAX_CAVITY];
+    size_t cavityCount = 0, boundaryCount = 0;
+
+    assert(0 <= point.x && point.x < WIDTH && 0 <= point.y && point.y < HEIGHT);
+
+    int32_t first = LocateTriangle(dt, point);
+    uint32_t existing = VertexAt(dt, first, point);
+    if (existing != LABEL_NONE) {
+        dt->vertexTriangles[vertex] = -1;
+        if (vertex < existing) {
+            ReplaceDelaunayVertex(dt, existing, vertex);
+            dt->coincident[vertex] = existing;
+        } else {
+            uint32_t *link = &dt->coincident[existing];
+            while (*link < vertex) {
+                link = &dt->coincident[*link];
+            }
+            dt->coincident[vertex] = *link;
+            *link = vertex;
+        }
+        return;
+    }
+
+    cavity[cavityCount++] = first;
+    for (size_t c = 0; c < cavityCount; ++c) {
+        const Triangle *t = &dt->triangles[cavity[c]];
+
+        for (int i = 0; i < 3; ++i) {
+            int32_t neighbour = t->neighbours[i];
+            int inCavity = neighbour < 0;
+
+            for (size_t k = 0; k < cavityCount && !inCavity; ++k) {
+                inCavity = cavity[k] == neighbour;
+            }
+            if (inCavity) {
+                continue;
+            }
+
+            const uint32_t *v = dt->triangles[neighbour].vertices;
+            if (InCircle(DelaunayPoint(dt, v[0]), DelaunayPoint(dt, v[1]), DelaunayPoint(dt, v[2]), point) > 0) {
+                assert(cavityCount < DELAUNAY_MAX_CAVITY);
+                cavity[cavityCount++] = neighbour;
+            }
+        }
+    }
+
+    for (size_t c = 0; c < cavityCount; ++c) {
+        const Triangle *t = &dt->triangles[cavity[c]];
+
+        for (int i = 0; i < 3; ++i) {
+            int inCavity = 0;
+            for (size_t k = 0; k < cavityCount && !inCavity; ++k) {
+                inCavity = cavity[k] == t->neighbours[i];
+            }
+            if (!inCavity) {
+                assert(boundaryCount < DELAUNAY_MAX_CAVITY);
+                boundary[boundaryCount++] = (BoundaryEdge){
+                    t->vertices[(i + 1) % 3], t->vertices[(i + 2) % 3], t->neighbours[i]
+                };
+            }
+        }
+        MarkAffectedTriangle(dt, cavity[c]);
+        dt->freeTriangles[dt->freeCount++] = cavity[c];
+    }
+
+    for (size_t e = 0; e < boundaryCount; ++e) {
+        created[e] = AllocTriangle(dt);
+        dt->triangles[created[e]] = (Triangle){
+            {boundary[e].from, boundary[e].to, vertex},
+            {-1, -1, -1}
+        };
+    }
+    LinkTriangles(dt, created, boundaryCount, boundary, boundaryCount);
+    dt->affectedFlags[vertex] = DELAUNAY_INSERTED;
+}
+
+/**
+ * @brief Remove a vertex and fill the hole left by its star with Delaunay
+ * ears: convex corners whose circumcircle holds no other vertex of the hole.
+ * A vertex with others at its position is replaced by the next one of its
+ * chain instead, and a chained vertex is only unlinked.
+ * 
+ * @param dt 
+ * @param vertex 
+ * @return * Delaunay 
+ */
+void DelaunayRemove(Delaunay *dt, uint32_t vertex) 
+{
+    uint32_t ring[DELAUNAY_MAX_CAVITY];
+    BoundaryEdge boundary[DELAUNAY_MAX_CAVITY];
+    int32_t created[DELAUNAY_MAX_CAVITY];
+    size_t ringCount = 0, createdCount = 0;
+    int32_t first = dt->vertexTriangles[vertex];
+
+    if (first < 0) {
+        uint32_t head = VertexAt(dt, LocateTriangle(dt, dt->points[vertex]), dt->points[vertex]);
+        if (head != LABEL_NONE) {
+            uint32_t *link = &dt->coincident[head];
+            while (*link != LABEL_NONE && *link != vertex) {
+                link = &dt->coincident[*link];
+            }
+            *link = dt->coincident[vertex];
+            dt->coincident[vertex] = LABEL_NONE;
+        }
+        return;
+    }
+    if (dt->coincident[vertex] != LABEL_NONE) {
+        ReplaceDelaunayVertex(dt, vertex, dt->coincident[vertex]);
+        dt->coincident[vertex] = LABEL_NONE;
+        return;
+    }
+
+    int32_t triangle = first;
+    do {
+        const Triangle *t = &dt->triangles[triangle];
+        int i = t->vertices[0] == vertex ? 0 : t->vertices[1] == vertex ? 1 : 2;
+
+        assert(ringCount < DELAUNAY_MAX_CAVITY);
+        ring[ringCount] = t->vertices[(i + 1) % 3];
+        boundary[ringCount++] = (BoundaryEdge){
+            t->vertices[(i + 1) % 3], t->vertices[(i + 2) % 3], t->neighbours[i]
+        };
+        MarkAffectedTriangle(dt, triangle);
+        dt->freeTriangles[dt->freeCount++] = triangle;
+        triangle = t->neighbours[(i + 1) % 3];
+    } while (triangle != first);
+
+    dt->vertexTriangles[vertex] = -1;
+
+    while (ringCount > 3) {
+        size_t ear = ringCount;
+
+        for (size_t i = 0; i < ringCount && ear == ringCount; ++i) {
+            Vec2 a = DelaunayPoint(dt, ring[(i + ringCount - 1) % ringCount]);
+            Vec2 b = DelaunayPoint(dt, ring[i]);
+            Vec2 c = DelaunayPoint(dt, ring[(i + 1) % ringCount]);
+
+            if (Orient(a, b, c) <= 0) {
+                continue;
+            }
+
+            int empty = 1;
+            for (size_t k = 0; k < ringCount && empty; ++k) {
+                if (k != i && k != (i + 1) % ringCount && k != (i + ringCount - 1) % ringCount) {
+                    empty = InCircle(a, b, c, DelaunayPoint(dt, ring[k])) <= 0;
+                }
+            }
+            if (empty) {
+                ear = i;
+            }
+        }
+        assert(ear < ringCount);
+
+        created[createdCount] = AllocTriangle(dt);
+        dt->triangles[created[createdCount++]] = (Triangle){
+            {ring[(ear + ringCount - 1) % ringCount], ring[ear], ring[(ear + 1) % ringCount]},
+            {-1, -1, -1}
+        };
+        memmove(&ring[ear], &ring[ear + 1], (ringCount - ear - 1) * sizeof(uint32_t));
+        --ringCount;
+    }
+
+    created[createdCount] = AllocTriangle(dt);
+    dt->triangles[created[createdCount++]] = (Triangle){
+        {ring[0], ring[1], ring[2]},
+        {-1, -1, -1}
+    };
+    LinkTriangles(dt, created, createdCount, boundary, createdCount + 2);
+}
+
+/**
+ * @brief Move a vertex to a new position, which may be shared with other
+ * vertices
+ * 
+ * @param dt 
+ * @param vertex 
+ * @param position 
+ * @return * Move 
+ */
+void DelaunayMove(Delaunay *dt, uint32_t vertex, Vec2 position) 
+{
+    DelaunayRemove(dt, vertex);
+    dt->points[vertex] = position;
+    DelaunayInsert(dt, vertex);
+}
+
+/**
+ * @brief Find the lowest index among the vertices as close to a point as a
+ * given one. Such vertices lie on an empty circle around the point, so they
+ * are reached from each other through edges of the triangulation.
+ * 
+ * @param dt 
+ * @param vertex 
+ * @param point 
+ * @return uint32_t 
+ */
+uint32_t LowestTiedVertex(const Delaunay *dt, uint32_t vertex, Vec2 point) 
+{
+    uint32_t tied[DELAUNAY_MAX_CAVITY];
+    size_t tiedCount = 0;
+    int dist = SquareDistance(dt->points[vertex], point);
+    uint32_t lowest = vertex;
+
+    tied[tiedCount++] = vertex;
+    for (size_t n = 0; n < tiedCount; ++n) {
+        int32_t first = dt->vertexTriangles[tied[n]];
+        int32_t triangle = first;
+
+        do {
+            const Triangle *t = &dt->triangles[triangle];
+            int i = t->vertices[0] == tied[n] ? 0 : t->vertices[1] == tied[n] ? 1 : 2;
+            uint32_t other = t->vertices[(i + 1) % 3];
+
+            if (other < DELAUNAY_SUPER_VERTEX && SquareDistance(dt->points[other], point) == dist) {
+                int seen = 0;
+                for (size_t k = 0; k < tiedCount && !seen; ++k) {
+                    seen = tied[k] == other;
+                }
+                if (!seen) {
+                    assert(tiedCount < DELAUNAY_MAX_CAVITY);
+                    tied[tiedCount++] = other;
+                    lowest = other < lowest ? other : lowest;
+                }
+            }
+            triangle = t->neighbours[(i + 1) % 3];
+        } while (triangle != first);
+    }
+
+    return lowest;
+}
+
+/**
+ * @brief Relabel the pixels touched by the changes since the last repaint. A
+ * pixel can only move to an affected seed or keep its current one, so only
+ * those are compared. A pixel that changes seed, or that belongs to a freshly
+ * inserted one, may also tie with seeds that are not affected, which
+ * LowestTiedVertex settles.
+ * 
+ * @param dt 
+ * @return * Repaint 
+ */
+void RepaintDelaunayChanges(Delaunay *dt) 
+{
+    size_t candidatesCount = 0;
+
+    for (size_t i = 0; i < dt->affectedCount; ++i) {
+        if (dt->vertexTriangles[dt->affected[i]] >= 0) {
+            dt->affected[candidatesCount++] = dt->affected[i];
+        } else {
+            dt->affectedFlags[dt->affected[i]] = 0;
+        }
+    }
+    dt->affectedCount = candidatesCount;
+
+    #pragma omp parallel for
+    for (int y = dt->dirtyMinY; y <= dt->dirtyMaxY; ++y) {
+        for (int x = dt->dirtyMinX; x <= dt->dirtyMaxX; ++x) {
+            Vec2 point = {x, y};
+            uint32_t closestSeedIdx = labels[y][x];
+            int closestDist = INT32_MAX;
+
+            uint32_t previousSeedIdx = closestSeedIdx;
+            int kept = closestSeedIdx < dt->capacity && dt->vertexTriangles[closestSeedIdx] >= 0;
+
+            if (kept) {
+                closestDist = SquareDistance(dt->points[closestSeedIdx], point);
+            }
+
+            for (size_t i = 0; i < candidatesCount; ++i) {
+                uint32_t seedIdx = dt->affected[i];
+                int currDist = SquareDistance(dt->points[seedIdx], point);
+
+                if (currDist < closestDist || (currDist == closestDist && seedIdx < closestSeedIdx)) {
+                    closestDist = currDist;
+                    closestSeedIdx = seedIdx;
+                }
+            }
+            if (closestSeedIdx != previousSeedIdx || dt->affectedFlags[closestSeedIdx] == DELAUNAY_INSERTED) {
+                closestSeedIdx = LowestTiedVertex(dt, closestSeedIdx, point);
+            }
+
+            labels[y][x] = closestSeedIdx;
+        }
+    }
+
+    ClearDelaunayChanges(dt);
+}
+
+/**
+ * @brief Simulate an editing session: triangulate the seeds, then move them
+ * one at a time, repainting only the cells each move affects
+ * 
+ * @return * Edit 
+ */
+void EditSeeds() 
+{
+    Delaunay dt;
+    InitDelaunay(&dt, seeds, SEEDS_COUNT);
+
+    for (size_t i = 0; i < SEEDS_COUNT; ++i) {
+        DelaunayInsert(&dt, i);
+    }
+    ClearDelaunayChanges(&dt);
+
+    for (size_t i = 0; i < EDIT_MOVES_COUNT; ++i) {
+        uint32_t seedIdx = rand() % SEEDS_COUNT;
+        Vec2 position = {
+            seeds[seedIdx].x + rand() % (2 * EDIT_MOVE_DISTANCE + 1) - EDIT_MOVE_DISTANCE,
+            seeds[seedIdx].y + rand() % (2 * EDIT_MOVE_DISTANCE + 1) - EDIT_MOVE_DISTANCE
+        };
+        position.x = position.x < 0 ? 0 : position.x < WIDTH ? position.x : WIDTH - 1;
+        position.y = position.y < 0 ? 0 : position.y < HEIGHT ? position.y : HEIGHT - 1;
+
+        DelaunayMove(&dt, seedIdx, position);
+        RepaintDelaunayChanges(&dt);
+    }
+
+    FreeDelaunay(&dt);
+}
+
+/**
+ * @brief Encode the image as a PPM into a buffer large enough for the header
+ * and WIDTH * HEIGHT * 3 bytes
+ * 
+ * @param frame 
+ * @return size_t Size of the encoded frame
+ */
+size_t EncodeImagePPM(uint8_t *frame) 
+{
+    size_t size = sprintf((char *)frame, "P6\n%d %d 255\n", WIDTH, HEIGHT);
+
+    for (size_t y = 0; y < HEIGHT; ++y) {
+        for (size_t x = 0; x < WIDTH; ++x) {
+            Color pixel = image[y][x];
+
+            frame[size++] = (uint8_t)((pixel&0x0000FF) >> 8 * 0);
+            frame[size++] = (uint8_t)((pixel&0x00FF00) >> 8 * 1);
+            frame[size++] = (uint8_t)((pixel&0xFF0000) >> 8 * 2);
+        }
+    }
+    return size;
+}
+
+/**
+ * @brief Write a whole buffer to a file descriptor
+ * 
+ * @param fd 
+ * @param data 
+ * @param size 
+ * @return * Write 
+ */
+void WriteAll(int fd, const uint8_t *data, size_t size) 
+{
+    while (size > 0) {
+        ssize_t written = write(fd, data, size);
+
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            fprintf(stderr, "ERROR: cannot write output: %s\n", strerror(errno));
+            exit(1);
+        }
+        data += written;
+        size -= written;
+    }
+}
+
+/**
+ * @brief Hand a buffer to a pipe with vmsplice, so that the pipe references
+ * its pages instead of copying them. The pages must not be modified until the
+ * reader has consumed them. Returns 0 when vmsplice is not available for this
+ * descriptor, before anything was written.
+ * 
+ * @param fd 
+ * @param data 
+ * @param size 
+ * @return int 
+ */
+int SpliceToPipe(int fd, const uint8_t *data, size_t size) 
+{
+#ifdef __linux__
+    const uint8_t *begin = data;
+
+    while (size > 0) {
+        struct iovec iov = {(void *)data, size};
+        ssize_t written = vmsplice(fd, &iov, 1, 0);
+
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written < 0 && data == begin && (errno == EINVAL || errno == ENOSYS || errno == EBADF)) {
+            return 0;
+        }
+        if (written <= 0) {
+            fprintf(stderr, "ERROR: cannot splice output: %s\n", strerror(errno));
+            exit(1);
+        }
+        data += written;
+        size -= written;
+    }
+    return 1;
+#else
+    (void)fd; (void)data; (void)size;
+    return 0;
+#endif
+}
+
+/**
+ * @brief Move the seeds along their velocities, bouncing off the image borders
+ * 
+ * @return * Move 
+ */
+void MoveSeeds() 
+{
+    for (size_t i = 0; i < SEEDS_COUNT; ++i) {
+        Vec2 *seed = &seeds[i], *velocity = &seedVelocities[i];
+
+        seed->x += velocity->x;
+        seed->y += velocity->y;
+        if (seed->x < 0 || seed->x >= WIDTH) {
+            velocity->x = -velocity->x;
+            seed->x = seed->x < 0 ? -seed->x : 2 * (WIDTH - 1) - seed->x;
+        }
+        if (seed->y < 0 || seed->y >= HEIGHT) {
+            velocity->y = -velocity->y;
+            seed->y = seed->y < 0 ? -seed->y : 2 * (HEIGHT - 1) - seed->y;
+        }
+    }
+}
+
+/**
+ * @brief Stream an animation of drifting seeds to stdout as concatenated PPM
+ * frames. When stdout is a pipe, fully rendered frames are handed over with
+ * vmsplice from page-aligned buffers. A buffer is only rendered into again
+ * once more than a pipe's worth of later frames has gone through the pipe,
+ * so the reader is done with its pages; this holds as long as the reader
+ * copies the data out rather than splicing it further.
+ * 
+ * @param framesCount 
+ * @return * Animate 
+ */
+void AnimateVoronoi(int framesCount) 
+{
+    size_t pageSize = sysconf(_SC_PAGESIZE);
+    size_t frameCapacity = (WIDTH * HEIGHT * 3 + 64 + pageSize - 1) / pageSize * pageSize;
+    size_t buffersCount = 1;
+    struct stat st;
+    int spliceable = fstat(STDOUT_FILENO, &st) == 0 && S_ISFIFO(st.st_mode);
+
+#if defined(__linux__) && defined(F_GETPIPE_SZ)
+    if (spliceable) {
+        fcntl(STDOUT_FILENO, F_SETPIPE_SZ, (int)frameCapacity);
+        int pipeSize = fcntl(STDOUT_FILENO, F_GETPIPE_SZ);
+        buffersCount = (pipeSize > 0 ? (pipeSize + frameCapacity - 1) / frameCapacity : 1) + 1;
+    }
+#endif
+
+    uint8_t **frames = malloc(buffersCount * sizeof(uint8_t *));
+    assert(frames != NULL);
+    for (size_t i = 0; i < buffersCount; ++i) {
+        frames[i] = aligned_alloc(pageSize, frameCapacity);
+        assert(frames[i] != NULL);
+    }
+
+    for (size_t i = 0; i < SEEDS_COUNT; ++i) {
+        seedVelocities[i].x = rand() % (2 * ANIMATE_MAX_SPEED + 1) - ANIMATE_MAX_SPEED;
+        seedVelocities[i].y = rand() % (2 * ANIMATE_MAX_SPEED + 1) - ANIMATE_MAX_SPEED;
+    }
+
+    struct timespec begin, end;
+    double outputSeconds = 0;
+
+    for (int frame = 0; frame < framesCount; ++frame) {
+        uint8_t *buffer = frames[frame % buffersCount];
+
+        RenderVoronoi();
+        RenderLabels(seeds);
+        RenderSeedMarkers();
+        size_t size = EncodeImagePPM(buffer);
+
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &begin);
+        if (!spliceable || !SpliceToPipe(STDOUT_FILENO, buffer, size)) {
+            spliceable = 0;
+            WriteAll(STDOUT_FILENO, buffer, size);
+        }
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &end);
+        outputSeconds += (end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) * 1e-9;
+
+        MoveSeeds();
+    }
+
+    fprintf(stderr, "%d frames through %s, %.3f ms of CPU per frame on output\n",
+            framesCount, spliceable ? "vmsplice" : "write", outputSeconds * 1e3 / (framesCount > 0 ? framesCount : 1));
+
+    for (size_t i = 0; i < buffersCount; ++i) {
+        free(frames[i]);
+    }
+    free(frames);
+}
+
+/**
+ * @brief Copy a file to stdout. A pipe gets the file pages through splice,
+ * without passing them through user space; anything else gets plain writes.
+ * 
+ * @param filePath 
+ * @return * Relay 
+ */
+void RelayFile(const char *filePath) 
+{
+    int fd = open(filePath, O_RDONLY);
+
+    if (fd < 0) {
+        fprintf(stderr, "ERROR: cannot read file %s: %s\n", filePath, strerror(errno));
+        exit(1);
+    }
+
+#ifdef __linux__
+    for (;;) {
+        ssize_t moved = splice(fd, NULL, STDOUT_FILENO, NULL, RELAY_CHUNK_SIZE, SPLICE_F_MOVE | SPLICE_F_MORE);
+
+        if (moved < 0 && errno == EINTR) {
+            continue;
+        }
+        if (moved == 0) {
+            close(fd);
+            return;
+        }
+        if (moved < 0) {
+            if (errno != EINVAL && errno != ENOSYS) {
+                fprintf(stderr, "ERROR: cannot splice file %s: %s\n", filePath, strerror(errno));
+                exit(1);
+            }
+            break;
+        }
+    }
+#endif
+
+    uint8_t *buffer = malloc(RELAY_CHUNK_SIZE);
+    assert(buffer != NULL);
+
+    ssize_t count;
+    while ((count = read(fd, buffer, RELAY_CHUNK_SIZE)) != 0) {
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count < 0) {
+            fprintf(stderr, "ERROR: cannot read file %s: %s\n", filePath, strerror(errno));
+            exit(1);
+        }
+        WriteAll(STDOUT_FILENO, buffer, count);
+    }
+
+    free(buffer);
+    close(fd);
+}
+
+/**
+ * @brief Get the square of the euclidean distance between two points in 3D
+ * 
+ * @param pointA 
+ * @param pointB 
+ * @return int 
+ */
+int SquareDistance3D(Vec3 pointA, Vec3 pointB) 
+{
+    int dx = pointA.x - pointB.x;
+    int dy = pointA.y - pointB.y;
+    int dz = pointA.z - pointB.z;
+
+    return dx * dx + dy * dy + dz * dz;
+}
+
+/**
+ * @brief Generate random seeds inside the voxel grid
+ * 
+ * @return * Generate 
+ */
+void GenerateRandomVolumeSeeds() 
+{
+    for (size_t i = 0; i < VOLUME_SEEDS_COUNT; ++i) {
+        volumeSeeds[i].x = rand() % VOLUME_SIZE;
+        volumeSeeds[i].y = rand() % VOLUME_SIZE;
+        volumeSeeds[i].z = rand() % VOLUME_SIZE;
+    }
+}
+
+/**
+ * @brief Get the index of the spatial grid cell containing a point
+ * 
+ * @param point 
+ * @return size_t 
+ */
+size_t VolumeGridCell(Vec3 point) 
+{
+    size_t cx = point.x / VOLUME_GRID_CELL_SIZE;
+    size_t cy = point.y / VOLUME_GRID_CELL_SIZE;
+    size_t cz = point.z / VOLUME_GRID_CELL_SIZE;
+
+    return (cz * VOLUME_GRID_SIZE + cy) * VOLUME_GRID_SIZE + cx;
+}
+
+/**
+ * @brief Bucket the volume seeds into the spatial grid using a counting sort
+ * 
+ * @return * Build 
+ */
+void BuildVolumeGrid() 
+{
+    size_t cellsCount = VOLUME_GRID_SIZE * VOLUME_GRID_SIZE * VOLUME_GRID_SIZE;
+
+    memset(volumeGridStart, 0, sizeof(volumeGridStart));
+    for (size_t i = 0; i < VOLUME_SEEDS_COUNT; ++i) {
+        ++volumeGridStart[VolumeGridCell(volumeSeeds[i]) + 1];
+    }
+    for (size_t i = 0; i < cellsCount; ++i) {
+        volumeGridStart[i + 1] += volumeGridStart[i];
+    }
+
+    uint32_t fill[VOLUME_GRID_SIZE * VOLUME_GRID_SIZE * VOLUME_GRID_SIZE];
+    memcpy(fill, volumeGridStart, sizeof(fill));
+    for (size_t i = 0; i < VOLUME_SEEDS_COUNT; ++i) {
+        volumeGridSeeds[fill[VolumeGridCell(volumeSeeds[i])]++] = i;
+    }
+}
+
+/**
+ * @brief Find the volume seed closest to a voxel, searching only the grid cells
+ * within the distance of a hinted seed
+ * 
+ * @param point 
+ * @param hint 
+ * @return uint32_t 
+ */
+uint32_t NearestVolumeSeed(Vec3 point, uint32_t hint) 
+{
+    uint32_t closestSeedIdx = hint;
+    int closestDist = SquareDistance3D(volumeSeeds[hint], point);
+    int radius = (int)ceil(sqrt(closestDist));
+
+    int beginX = (point.x - radius < 0 ? 0 : point.x - radius) / VOLUME_GRID_CELL_SIZE;
+    int beginY = (point.y - radius < 0 ? 0 : point.y - radius) / VOLUME_GRID_CELL_SIZE;
+    int beginZ = (point.z - radius < 0 ? 0 : point.z - radius) / VOLUME_GRID_CELL_SIZE;
+    int endX = (point.x + radius) / VOLUME_GRID_CELL_SIZE;
+    int endY = (point.y + radius) / VOLUME_GRID_CELL_SIZE;
+    int endZ = (point.z + radius) / VOLUME_GRID_CELL_SIZE;
+    endX = endX < VOLUME_GRID_SIZE ? endX : VOLUME_GRID_SIZE - 1;
+    endY = endY < VOLUME_GRID_SIZE ? endY : VOLUME_GRID_SIZE - 1;
+    endZ = endZ < VOLUME_GRID_SIZE ? endZ : VOLUME_GRID_SIZE - 1;
+
+    for (int cz = beginZ; cz <= endZ; ++cz) {
+        for (int cy = beginY; cy <= endY; ++cy) {
+            for (int cx = beginX; cx <= endX; ++cx) {
+                size_t cell = ((size_t)cz * VOLUME_GRID_SIZE + cy) * VOLUME_GRID_SIZE + cx;
+
+                for (uint32_t i = volumeGridStart[cell]; i < volumeGridStart[cell + 1]; ++i) {
+                    uint32_t seedIdx = volumeGridSeeds[i];
+                    int currDist = SquareDistance3D(volumeSeeds[seedIdx], point);
+
+                    if (currDist < closestDist) {
+                        closestDist = currDist;
+                        closestSeedIdx = seedIdx;
+                    }
+                }
+            }
+        }
+    }
+
+    return closestSeedIdx;
+}
+
+/**
+ * @brief Generate a color for a volume seed
+ * 
+ * @param seed 
+ * @return Color 
+ */
+Color VolumeSeedToColor(Vec3 seed) 
+{
+    Vec2 point = {seed.x ^ seed.z, seed.y};
+    return SeedToColor(point);
+}
+
+/**
+ * @brief Render the 3D Voronoi volume one Z-slice at a time, appending every
+ * slice to the file as a separate PPM image. Only the current and previous
+ * slice labels are kept; the previous slice seeds the search of the next one.
+ * 
+ * @param filePath 
+ * @return * Render 
+ */
+void RenderVolume(const char *filePath) 
+{
+    FILE *file = fopen(filePath, "wb");
+
+    if (file == NULL) {
+        fprintf(stderr, "ERROR: cannot write into file %s: %s\n", filePath, strerror(errno));
+        exit(1);
+    }
+
+    static uint8_t row[VOLUME_SIZE * 3];
+
+    for (int z = 0; z < VOLUME_SIZE; ++z) {
+        uint32_t (*prevSlice)[VOLUME_SIZE] = volumeSlices[(z + 1) % 2];
+        uint32_t (*currSlice)[VOLUME_SIZE] = volumeSlices[z % 2];
+
+        fprintf(file, "P6\n");
+        fprintf(file, "%d %d 255\n", VOLUME_SIZE, VOLUME_SIZE);
+
+        for (int y = 0; y < VOLUME_SIZE; ++y) {
+            for (int x = 0; x < VOLUME_SIZE; ++x) {
+                Vec3 point = {x, y, z};
+                uint32_t hint = 0;
+
+                if (z > 0) {
+                    hint = prevSlice[y][x];
+                }
+                if (x > 0 && (z == 0 || SquareDistance3D(volumeSeeds[currSlice[y][x - 1]], point)
+                                      < SquareDistance3D(volumeSeeds[hint], point))) {
+                    hint = currSlice[y][x - 1];
+                }
+
+                currSlice[y][x] = NearestVolumeSeed(point, hint);
+
+                Color pixel = VolumeSeedToColor(volumeSeeds[currSlice[y][x]]);
+                row[x * 3 + 0] = (uint8_t)((pixel&0x0000FF) >> 8 * 0);
+                row[x * 3 + 1] = (uint8_t)((pixel&0x00FF00) >> 8 * 1);
+                row[x * 3 + 2] = (uint8_t)((pixel&0xFF0000) >> 8 * 2);
+            }
+
+            fwrite(row, sizeof(row), 1, file);
+            assert(!ferror(file));
+        }
+    }
+
+    int err = fclose(file);
+    assert(err == 0);
+}
+
+/**
+ * @brief Generate random seeds uniformly distributed on the unit sphere
+ * 
+ * @return * Generate 
+ */
+void GenerateRandomSphereSeeds() 
+{
+    for (size_t i = 0; i < SPHERE_SEEDS_COUNT; ++i) {
+        double z = 2.0 * rand() / RAND_MAX - 1;
+        double angle = 2 * M_PI * rand() / RAND_MAX;
+        double r = sqrt(1 - z * z);
+
+        sphereSeeds[i] = (Vec3f){r * cos(angle), r * sin(angle), z};
+    }
+}
+
+/**
+ * @brief Get the grid coordinate of a unit vector component
+ * 
+ * @param value 
+ * @return int 
+ */
+int SphereGridCoord(float value) 
+{
+    int coord = (int)((value + 1) / SPHERE_GRID_CELL_SIZE);
+    return coord < 0 ? 0 : coord < SPHERE_GRID_SIZE ? coord : SPHERE_GRID_SIZE - 1;
+}
+
+/**
+ * @brief Get the index of the spatial grid cell containing a unit vector
+ * 
+ * @param point 
+ * @return size_t 
+ */
+size_t SphereGridCell(Vec3f point) 
+{
+    return ((size_t)SphereGridCoord(point.z) * SPHERE_GRID_SIZE + SphereGridCoord(point.y)) * SPHERE_GRID_SIZE
+           + SphereGridCoord(point.x);
+}
+
+/**
+ * @brief Bucket the sphere seeds into a 3D grid over [-1, 1]^3 using a
+ * counting sort
+ * 
+ * @return * Build 
+ */
+void BuildSphereGrid() 
+{
+    size_t cellsCount = SPHERE_GRID_SIZE * SPHERE_GRID_SIZE * SPHERE_GRID_SIZE;
+
+    memset(sphereGridStart, 0, sizeof(sphereGridStart));
+    for (size_t i = 0; i < SPHERE_SEEDS_COUNT; ++i) {
+        ++sphereGridStart[SphereGridCell(sphereSeeds[i]) + 1];
+    }
+    for (size_t i = 0; i < cellsCount; ++i) {
+        sphereGridStart[i + 1] += sphereGridStart[i];
+    }
+
+    static uint32_t fill[SPHERE_GRID_SIZE * SPHERE_GRID_SIZE * SPHERE_GRID_SIZE];
+    memcpy(fill, sphereGridStart, sizeof(fill));
+    for (size_t i = 0; i < SPHERE_SEEDS_COUNT; ++i) {
+        sphereGridSeeds[fill[SphereGridCell(sphereSeeds[i])]++] = i;
+    }
+}
+
+/**
+ * @brief Find the sphere seed closest to a unit vector. On the sphere the
+ * largest dot product is the smallest chord, so the grid cells within the
+ * chord to a hinted seed are enough.
+ * 
+ * @param point 
+ * @param hint 
+ * @return uint32_t 
+ */
+uint32_t NearestSphereSeed(Vec3f point, uint32_t hint) 
+{
+    Vec3f seed = sphereSeeds[hint];
+    uint32_t closestSeedIdx = hint;
+    float closestDot = seed.x * point.x + seed.y * point.y + seed.z * point.z;
+    float chord = sqrtf(fmaxf(2 - 2 * closestDot, 0)) + 1e-5f;
+
+    int beginX = SphereGridCoord(point.x - chord), endX = SphereGridCoord(point.x + chord);
+    int beginY = SphereGridCoord(point.y - chord), endY = SphereGridCoord(point.y + chord);
+    int beginZ = SphereGridCoord(point.z - chord), endZ = SphereGridCoord(point.z + chord);
+
+    for (int cz = beginZ; cz <= endZ; ++cz) {
+        for (int cy = beginY; cy <= endY; ++cy) {
+            for (int cx = beginX; cx <= endX; ++cx) {
+                size_t cell = ((size_t)cz * SPHERE_GRID_SIZE + cy) * SPHERE_GRID_SIZE + cx;
+
+                for (uint32_t i = sphereGridStart[cell]; i < sphereGridStart[cell + 1]; ++i) {
+                    uint32_t seedIdx = sphereGridSeeds[i];
+                    Vec3f other = sphereSeeds[seedIdx];
+                    float currDot = other.x * point.x + other.y * point.y + other.z * point.z;
+
+                    if (currDot > closestDot) {
+                        closestDot = currDot;
+                        closestSeedIdx = seedIdx;
+                    }
+                }
+            }
+        }
+    }
+
+    return closestSeedIdx;
+}
+
+/**
+ * @brief Generate a color for a sphere seed
+ * 
+ * @param seed 
+ * @return Color 
+ */
+Color SphereSeedToColor(Vec3f seed) 
+{
+    Vec2 point = {(int)((seed.x + 1) * 32767), (int)((seed.y + 1) * 32767) ^ (int)((seed.z + 1) * 32767)};
+    return SeedToColor(point);
+}
+
+/**
+ * @brief Render the spherical Voronoi diagram as an equirectangular map.
+ * Longitude trig is computed once per column and latitude trig once per row;
+ * rows are rendered in parallel, each pixel hinted by its left neighbour.
+ * 
+ * @param filePath 
+ * @return * Render 
+ */
+void RenderSphere(const char *filePath) 
+{
+    static float cosLongitude[SPHERE_WIDTH], sinLongitude[SPHERE_WIDTH];
+
+    for (int x = 0; x < SPHERE_WIDTH; ++x) {
+        double longitude = (x + 0.5) * 2 * M_PI / SPHERE_WIDTH - M_PI;
+        cosLongitude[x] = cos(longitude);
+        sinLongitude[x] = sin(longitude);
+    }
+
+    #pragma omp parallel for schedule(dynamic)
+    for (int y = 0; y < SPHERE_HEIGHT; ++y) {
+        double latitude = M_PI / 2 - (y + 0.5) * M_PI / SPHERE_HEIGHT;
+        float cosLatitude = cos(latitude);
+        float sinLatitude = sin(latitude);
+        uint32_t hint = 0;
+
+        for (int x = 0; x < SPHERE_WIDTH; ++x) {
+            Vec3f point = {cosLatitude * cosLongitude[x], cosLatitude * sinLongitude[x], sinLatitude};
+
+            hint = NearestSphereSeed(point, hint);
+            sphereLabels[y][x] = hint;
+        }
+    }
+
+    FILE *file = fopen(filePath, "wb");
+
+    if (file == NULL) {
+        fprintf(stderr, "ERROR: cannot write into file %s: %s\n", filePath, strerror(errno));
+        exit(1);
+    }
+
+    static uint8_t row[SPHERE_WIDTH * 3];
+
+    fprintf(file, "P6\n");
+    fprintf(file, "%d %d 255\n", SPHERE_WIDTH, SPHERE_HEIGHT);
+    for (int y = 0; y < SPHERE_HEIGHT; ++y) {
+        for (int x = 0; x < SPHERE_WIDTH; ++x) {
+            Color pixel = SphereSeedToColor(sphereSeeds[sphereLabels[y][x]]);
+            row[x * 3 + 0] = (uint8_t)((pixel&0x0000FF) >> 8 * 0);
+            row[x * 3 + 1] = (uint8_t)((pixel&0x00FF00) >> 8 * 1);
+            row[x * 3 + 2] = (uint8_t)((pixel&0xFF0000) >> 8 * 2);
+        }
+
+        fwrite(row, sizeof(row), 1, file);
+        assert(!ferror(file));
+    }
+
+    int err = fclose(file);
+    assert(err == 0);
+}
+
+/**
+ * @brief Read an unsigned number from a sysfs file
+ * 
+ * @param fd 
+ * @param value 
+ * @return int 0 if the file cannot be read
+ */
+int ReadSysfsNumber(int fd, uint64_t *value) 
+{
+    char text[32];
+    ssize_t size = pread(fd, text, sizeof(text) - 1, 0);
+
+    if (size <= 0) {
+        return 0;
+    }
+    text[size] = '\0';
+    *value = strtoull(text, NULL, 10);
+    return 1;
+}
+
+/**
+ * @brief Open the energy counters of the RAPL package domains exposed through
+ * powercap, by Intel and by AMD processors alike. Subdomains such as cores
+ * are part of their package and are left out so that nothing counts twice.
+ * 
+ * @param rapl 
+ * @return size_t Number of readable domains, 0 when there is no RAPL or its
+ * counters are restricted to root
+ */
+size_t OpenRapl(Rapl *rapl) 
+{
+    glob_t paths;
+
+    rapl->count = 0;
+    if (glob(RAPL_ROOT "/intel-rapl:*", 0, NULL, &paths) != 0) {
+        return 0;
+    }
+
+    for (size_t i = 0; i < paths.gl_pathc && rapl->count < RAPL_MAX_DOMAINS; ++i) {
+        const char *name = strrchr(paths.gl_pathv[i], '/') + 1;
+        char path[PATH_MAX];
+        uint64_t value;
+
+        if (strchr(strchr(name, ':') + 1, ':') != NULL) {
+            continue;
+        }
+
+        snprintf(path, sizeof(path), "%s/max_energy_range_uj", paths.gl_pathv[i]);
+        int rangeFd = open(path, O_RDONLY);
+        int hasRange = rangeFd >= 0 && ReadSysfsNumber(rangeFd, &rapl->maxRanges[rapl->count]);
+        if (rangeFd >= 0) {
+            close(rangeFd);
+        }
+
+        snprintf(path, sizeof(path), "%s/energy_uj", paths.gl_pathv[i]);
+        int fd = open(path, O_RDONLY);
+        if (fd < 0 || !hasRange || !ReadSysfsNumber(fd, &value)) {
+            if (fd >= 0) {
+                close(fd);
+            }
+            continue;
+        }
+        rapl->fds[rapl->count++] = fd;
+    }
+
+    globfree(&paths);
+    return rapl->count;
+}
+
+/**
+ * @brief Sample the energy counter of every RAPL domain
+ * 
+ * @param rapl 
+ * @param energies Microjoules per domain
+ * @return * Read 
+ */
+void ReadRapl(const Rapl *rapl, uint64_t *energies) 
+{
+    for (size_t i = 0; i < rapl->count; ++i) {
+        if (!ReadSysfsNumber(rapl->fds[i], &energies[i])) {
+            energies[i] = 0;
+        }
+    }
+}
+
+/**
+ * @brief Energy spent by all domains between two samples. A counter lower
+ * than before has wrapped around at its max_energy_range_uj.
+ * 
+ * @param rapl 
+ * @param before 
+ * @param after 
+ * @return double Joules
+ */
+double RaplJoules(const Rapl *rapl, const uint64_t *before, const uint64_t *after) 
+{
+    double joules = 0;
+
+    for (size_t i = 0; i < rapl->count; ++i) {
+        uint64_t delta = after[i] >= before[i] ? after[i] - before[i] : rapl->maxRanges[i] - before[i] + after[i];
+        joules += delta * 1e-6;
+    }
+    return joules;
+}
+
+/**
+ * @brief Close the energy counters
+ * 
+ * @param rapl 
+ * @return * Close 
+ */
+void CloseRapl(Rapl *rapl) 
+{
+    for (size_t i = 0; i < rapl->count; ++i) {
+        close(rapl->fds[i]);
+    }
+    rapl->count = 0;
+}
+
+/**
+ * @brief Run one frame of a benchmarked stage. Writers start from the labels
+ * and image left by the stages before them.
+ * 
+ * @param stage 
+ * @return * Run 
+ */
+void RunBenchStage(BenchStage stage) 
+{
+    switch (stage) {
+    case BENCH_RENDER_EXACT:
+        RenderVoronoi();
+        break;
+    case BENCH_RENDER_POLYGON:
+        RenderVoronoiPolygons();
+        break;
+    case BENCH_RENDER_APPROXIMATE:
+        RenderVoronoiApproximate(APPROXIMATE_EPSILON);
+        break;
+    case BENCH_COLOR:
+        RenderLabels(seeds);
+        RenderSeedMarkers();
+        break;
+    case BENCH_WRITE_PPM:
+        SaveImageAsPPM(OUTPUT_FILE_PATH);
+        break;
+    case BENCH_WRITE_PNG:
+        StampSeedMarkers(seeds, SEEDS_COUNT);
+        SaveLabelsAsPNG(OUTPUT_PNG_FILE_PATH, seeds, SEEDS_COUNT);
+        break;
+    case BENCH_WRITE_GIF:
+        StampSeedMarkers(seeds, SEEDS_COUNT);
+        SaveLabelsAsGIF(OUTPUT_GIF_FILE_PATH, seeds, SEEDS_COUNT);
+        break;
+    default:
+        assert(0 && "unreachable");
+    }
+}
+
+/**
+ * @brief Time the render engines, the coloring and the writers frame by
+ * frame, each for at least BENCH_STAGE_SECONDS so the RAPL counters, which
+ * tick about every millisecond, see enough of it. Reports time and, when
+ * RAPL is readable, energy per frame and per megapixel. RAPL measures whole
+ * packages, so anything else running at the same time is counted too.
+ * 
+ * @return * Benchmark 
+ */
+void BenchStages() 
+{
+    Rapl rapl;
+    uint64_t before[RAPL_MAX_DOMAINS], after[RAPL_MAX_DOMAINS];
+    double megapixels = (double)WIDTH * HEIGHT * 1e-6;
+
+    if (OpenRapl(&rapl) == 0) {
+        printf("energy: no readable RAPL counters under %s, reporting time only\n", RAPL_ROOT);
+    }
+
+    FillImage(COLOR_BACKGROUND);
+    for (size_t stage = 0; stage < BENCH_STAGES_COUNT; ++stage) {
+        if ((stage == BENCH_WRITE_PNG || stage == BENCH_WRITE_GIF) && SEEDS_COUNT + 2 > PALETTE_MAX_COLORS) {
+            continue;
+        }
+
+        struct timespec begin, end;
+        double seconds = 0;
+        size_t frames = 0;
+
+        ReadRapl(&rapl, before);
+        clock_gettime(CLOCK_MONOTONIC, &begin);
+        while (seconds < BENCH_STAGE_SECONDS) {
+            RunBenchStage(stage);
+            ++frames;
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            seconds = (end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) * 1e-9;
+        }
+        ReadRapl(&rapl, after);
+
+        if (rapl.count > 0) {
+            double joules = RaplJoules(&rapl, before, after) / frames;
+            printf("energy: %-14s %8.2f ms/frame %8.3f J/frame %8.3f J/Mpixel\n",
+                   benchStageNames[stage], seconds * 1e3 / frames, joules, joules / megapixels);
+        } else {
+            printf("energy: %-14s %8.2f ms/frame\n", benchStageNames[stage], seconds * 1e3 / frames);
+        }
+    }
+
+    CloseRapl(&rapl);
+    ResetFrameArenas();
+}
+
+int main(int argc, char **argv) 
+{
+    srand(time(0));
+#ifdef _OPENMP
+    omp_set_num_threads(omp_get_max_threads() < MAX_THREADS ? omp_get_max_threads() : MAX_THREADS);
+#endif
+
+    if (argc > 1 && strcmp(argv[1], "volume") == 0) {
+        GenerateRandomVolumeSeeds();
+        BuildVolumeGrid();
+        RenderVolume(OUTPUT_VOLUME_FILE_PATH);
+        return 0;
+    }
+
+    if (argc > 1 && strcmp(argv[1], "sphere") == 0) {
+        GenerateRandomSphereSeeds();
+        BuildSphereGrid();
+        RenderSphere(OUTPUT_SPHERE_FILE_PATH);
+        return 0;
+    }
+
+    if (argc > 1 && strcmp(argv[1], "animate") == 0) {
+        FillImage(COLOR_BACKGROUND);
+        GenerateRandomSeeds();
+        AnimateVoronoi(argc > 2 ? atoi(argv[2]) : ANIMATE_FRAMES);
+        return 0;
+    }
+
+    if (argc > 1 && strcmp(argv[1], "jitter") == 0) {
+        int64_t originX = argc > 3 ? strtoll(argv[2], NULL, 10) : 0;
+        int64_t originY = argc > 3 ? strtoll(argv[3], NULL, 10) : 0;
+        Vec2 *points = malloc(JITTER_MAX_SEEDS * sizeof(Vec2));
+        assert(points != NULL);
+
+        RenderJittered(originX, originY);
+        size_t count = GenerateJitteredSeeds(points, originX, originY);
+        for (size_t i = 0; i < count; ++i) {
+            FillCircle(points[i], SEED_MARKER_RADIUS, SEED_MARKER_COLOR);
+        }
+        SaveImageAsPPM(OUTPUT_FILE_PATH);
+        free(points);
+        return 0;
+    }
+
+    if (argc > 1 && strcmp(argv[1], "fbm") == 0) {
+        int asFloat = strcmp(argv[argc - 1], "--float") == 0;
+        size_t octavesCount = argc > 2 && argv[2][0] != '-' ? strtoull(argv[2], NULL, 10) : FBM_OCTAVES;
+        float *values = malloc((size_t)WIDTH * HEIGHT * sizeof(float));
+        assert(values != NULL);
+
+        if (octavesCount == 0 || octavesCount > OCTAVES_COUNT) {
+            fprintf(stderr, "ERROR: between 1 and %zu octaves are supported\n", OCTAVES_COUNT);
+            exit(1);
+        }
+        RenderWorleyFBM(0, 0, octavesCount, values);
+        if (asFloat) {
+            SaveValuesAsPFM(OUTPUT_PFM_FILE_PATH, values);
+        } else {
+            SaveValuesAsPGM(OUTPUT_PGM_FILE_PATH, values);
+        }
+        free(values);
+        return 0;
+    }
+
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+        GenerateRandomSeeds();
+        BenchStages();
+        BenchApproximate();
+        BenchCVT();
+        ResetFrameArenas();
+        return 0;
+    }
+
+    if (argc > 1 && strcmp(argv[1], "nested") == 0) {
+        GenerateRandomSeeds();
+        RenderNested(argc > 2 && strncmp(argv[2], "--", 2) != 0 ? ParseCount(argv[2], 0, NESTED_MAX_FINE_SEEDS) : NESTED_FINE_SEEDS_COUNT);
+        RenderSeedMarkers();
+        SaveImageAsPPM(OUTPUT_FILE_PATH);
+        ResetFrameArenas();
+        return 0;
+    }
+
+    if (argc > 1 && strcmp(argv[1], "layers") == 0) {
+        RenderLayers();
+        SaveImageAsPPM(OUTPUT_FILE_PATH);
+        return 0;
+    }
+
+    if (argc > 2 && strcmp(argv[1], "relay") == 0) {
+        RelayFile(argv[2]);
+        return 0;
+    }
+
+    if (argc > 1 && strcmp(argv[1], "index-save") == 0) {
+        SeedGrid grid;
+        GenerateRandomSeeds();
+        BuildSeedGrid(&grid, seeds, SEEDS_COUNT, NULL);
+        SaveSeedGrid(&grid, argc > 2 ? argv[2] : SEED_INDEX_FILE_PATH);
+        FreeSeedGrid(&grid);
+        return 0;
+    }
+
+    if (argc > 1 && strcmp(argv[1], "index-load") == 0) {
+        SeedGrid grid;
+        LoadSeedGrid(&grid, argc > 2 ? argv[2] : SEED_INDEX_FILE_PATH);
+        FillImage(COLOR_BACKGROUND);
+        RenderVoronoiWithGrid(&grid, NULL);
+        RenderLabels(grid.points);
+        SaveImageAsPPM(OUTPUT_FILE_PATH);
+        FreeSeedGrid(&grid);
+        return 0;
+    }
+
+    if (argc > 1 && strcmp(argv[1], "vor-encode") == 0) {
+        Color *colors = malloc(SEEDS_COUNT * sizeof(Color));
+        assert(colors != NULL);
+
+        FillImage(COLOR_BACKGROUND);
+        GenerateRandomSeeds();
+        SortSeedsHilbert(seeds, SEEDS_COUNT);
+        RenderVoronoi();
+        RenderLabels(seeds);
+        RenderSeedMarkers();
+        SaveImageAsPPM(OUTPUT_FILE_PATH);
+        for (size_t i = 0; i < SEEDS_COUNT; ++i) {
+            colors[i] = SeedToColor(seeds[i]);
+        }
+
+        const char *filePath = argc > 2 ? argv[2] : OUTPUT_VOR_FILE_PATH;
+        size_t size = SaveVoronoiImage(filePath, seeds, colors, SEEDS_COUNT, METRIC_EUCLIDEAN, SEED_MARKER_RADIUS, SEED_MARKER_COLOR);
+        printf("%s: %zu bytes, %.0fx smaller than the PPM\n", filePath, size, WIDTH * HEIGHT * 3.0 / size);
+        free(colors);
+        return 0;
+    }
+
+    if (argc > 2 && strcmp(argv[1], "vor-decode") == 0) {
+        LoadVoronoiImage(argv[2]);
+        SaveImageAsPPM(OUTPUT_FILE_PATH);
+        ResetFrameArenas();
+        return 0;
+    }
+
+    if (argc > 1 && strcmp(argv[1], "outline") == 0) {
+        GenerateRandomSeeds();
+        RenderVoronoi();
+        SaveOutlines(seeds, argc > 2 ? argv[2] : OUTPUT_OUTLINE_FILE_PATH);
+        return 0;
+    }
+
+    if (argc > 3 && strcmp(argv[1], "outofcore-generate") == 0) {
+        GenerateSeedsFile(ParseCount(argv[2], 1, OUT_OF_CORE_MAX_SEEDS), argv[3]);
+        return 0;
+    }
+
+    if (argc > 4 && strcmp(argv[1], "query") == 0) {
+        SeedGrid grid;
+        LoadSeedGrid(&grid, argv[2]);
+        StreamNearestSeedQueries(&grid, argv[3], argv[4]);
+        FreeSeedGrid(&grid);
+        return 0;
+    }
+
+    int edges = argc > 1 && strcmp(argv[1], "edges") == 0;
+    double edgeWidth = EDGE_WIDTH;
+    size_t memoryBudget = 0;
+    const char *format = "ppm";
+    for (int i = 1; i + 1 < argc; ++i) {
+        if (strcmp(argv[i], "--edge-width") == 0) {
+            char *end;
+            edgeWidth = strtod(argv[i + 1], &end);
+            if (end == argv[i + 1] || *end != '\0' || !(edgeWidth > 0 && edgeWidth < INFINITY)) {
+                fprintf(stderr, "ERROR: edge width must be a positive number, got %s\n", argv[i + 1]);
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--format") == 0) {
+            format = argv[i + 1];
+        } else if (strcmp(argv[i], "--max-memory") == 0) {
+            memoryBudget = ParseByteSize(argv[i + 1]);
+        } else if (strcmp(argv[i], "--progress-file") == 0) {
+            StartProgress(argv[i + 1]);
+        }
+    }
+    for (int i = 1; i < argc && !progress.enabled; ++i) {
+        if (strcmp(argv[i], "--progress") == 0) {
+            StartProgress(NULL);
+        }
+    }
+    if (strcmp(format, "ppm") != 0 && strcmp(format, "png") != 0 && strcmp(format, "gif") != 0) {
+        fprintf(stderr, "ERROR: unknown output format %s, expected ppm, png or gif\n", format);
+        exit(1);
+    }
+    if (edges && strcmp(format, "ppm") != 0) {
+        fprintf(stderr, "ERROR: edges are anti-aliased and can only be written as ppm\n");
+        exit(1);
+    }
+
+    if (argc > 2 && strcmp(argv[1], "outofcore") == 0) {
+        if (strcmp(format, "ppm") != 0) {
+            fprintf(stderr, "ERROR: out-of-core renders are streamed as ppm only\n");
+            exit(1);
+        }
+        RenderVoronoiOutOfCore(argv[2], OUTPUT_FILE_PATH);
+        StopProgress();
+        ReportPeakMemory();
+        return 0;
+    }
+
+    if (memoryBudget > 0) {
+        RenderPlan plan;
+        PlanRender(memoryBudget, &plan);
+        ReportRenderPlan(&plan);
+#ifdef _OPENMP
+        omp_set_num_threads(plan.threads);
+#endif
+        if (!plan.inMemory) {
+            if (strcmp(format, "ppm") != 0) {
+                fprintf(stderr, "ERROR: banded renders are streamed as ppm only\n");
+                exit(1);
+            }
+            if (argc > 1 && argv[1][0] != '-') {
+                fprintf(stderr, "ERROR: %s cannot be rendered in bands, raise --max-memory\n", argv[1]);
+                exit(1);
+            }
+            GenerateRandomSeeds();
+            RenderVoronoiBanded(&plan, OUTPUT_FILE_PATH);
+            StopProgress();
+            ReportPeakMemory();
+            return 0;
+        }
+    }
+
+    FillImage(COLOR_BACKGROUND);
+    GenerateRandomSeeds();
+    if (edges) {
+        RenderVoronoiEdges(edgeWidth);
+    } else if (argc > 1 && strcmp(argv[1], "polygon") == 0) {
+        RenderVoronoiPolygons();
+    } else if (argc > 1 && strcmp(argv[1], "approx") == 0) {
+        double epsilon = APPROXIMATE_EPSILON;
+
+        if (argc > 2 && (argv[2][0] != '-' || argv[2][1] != '-')) {
+            char *end;
+            epsilon = strtod(argv[2], &end);
+            if (end == argv[2] || *end != '\0' || !(epsilon >= 0 && epsilon < INFINITY)) {
+                fprintf(stderr, "ERROR: epsilon must be a non-negative number, got %s\n", argv[2]);
+                exit(1);
+            }
+        }
+        RenderVoronoiApproximate(epsilon);
+    } else if (argc > 2 && strcmp(argv[1], "masked") == 0) {
+        DomainMask *mask = malloc(sizeof(DomainMask));
+        assert(mask != NULL);
+        LoadDomainMask(mask, argv[2]);
+        RenderVoronoiMasked(mask);
+        FreeDomainMask(mask);
+        free(mask);
+    } else if (argc > 1 && strcmp(argv[1], "balanced") == 0) {
+        float *density = argc > 2 && argv[2][0] != '-' ? LoadDensityPGM(argv[2]) : NULL;
+        RenderVoronoiBalanced(density);
+        free(density);
+    } else if (argc > 1 && strcmp(argv[1], "cvt") == 0) {
+        Vec2d *sites = malloc(SEEDS_COUNT * sizeof(Vec2d));
+        assert(sites != NULL);
+        SeedsToSites(sites);
+        RelaxLBFGS(sites, SEEDS_COUNT, CVT_PASSES, 0, NULL);
+        for (size_t i = 0; i < SEEDS_COUNT; ++i) {
+            seeds[i].x = (int)lround(sites[i].x);
+            seeds[i].y = (int)lround(sites[i].y);
+        }
+        free(sites);
+        RenderVoronoi();
+    } else if (argc > 1 && strcmp(argv[1], "edit") == 0) {
+        RenderVoronoi();
+        EditSeeds();
+    } else {
+        RenderVoronoi();
+    }
+    if (strcmp(format, "png") == 0) {
+        StampSeedMarkers(seeds, SEEDS_COUNT);
+        SaveLabelsAsPNG(OUTPUT_PNG_FILE_PATH, seeds, SEEDS_COUNT);
+    } else if (strcmp(format, "gif") == 0) {
+        StampSeedMarkers(seeds, SEEDS_COUNT);
+        SaveLabelsAsGIF(OUTPUT_GIF_FILE_PATH, seeds, SEEDS_COUNT);
+    } else {
+        ProgressStage(STAGE_COLOR);
+        if (!edges) {
+            RenderLabels(seeds);
+        }
+        RenderSeedMarkers();
+        ProgressStage(STAGE_WRITE);
+        SaveImageAsPPM(OUTPUT_FILE_PATH);
+    }
+    StopProgress();
+    if (argc > 1 && strcmp(argv[argc - 1], "--stats") == 0) {
+        ReportArenaUsage();
+    }
+    if (memoryBudget > 0) {
+        ReportPeakMemory();
+    }
+    ResetFrameArenas();
     return 0;
 } 
\ No newline at end of file